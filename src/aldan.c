@@ -38,7 +38,23 @@
 
 // Main driver code - initializes board and runs parser
 // The game memory also lives here as a game_state struct
-int main() {
+// Passing --regen-magics searches for new magic numbers instead of using the
+// precomputed ones, and prints them as the source for magictables.c
+// Passing --bench [epd file] [depth] runs the benchmark (see bench.c) and
+// exits with a failure code if any perft check failed
+// Passing --tune-data <positions file> <output file> [threads] writes the
+// positions out for tuning the evaluation (see tune.c)
+// Passing --analyze <positions file> [--depth N] [--threads T] [--hash MB]
+// [--nnue network file] searches every position, printing the results as JSON
+// (see analyze.c)
+// Passing --selfplay <openings file> <base> <test> [options] plays two search
+// configurations against each other (see selfplay.c)
+int main(int argc, char *argv[]) {
+    if ((argc > 1) && !strcmp(argv[1], "--regen-magics")) {
+        regen_magic_bitboards();
+        print_magic_tables(stdout);
+        return 0;
+    }
     // Init game memory
     game_state *gs = MALLOC(1, game_state);
     // Init lastmove
@@ -49,24 +65,75 @@ int main() {
     int do_unicode = 1;
     lm->dest_sq = -1;
     lm->orig_sq = -1;
-    // Set up board
-    init_board(gs);
     // Set up magic bitboards
     init_magic_bitboards();
+    // Set up non-sliding attack tables
+    init_attack_tables();
     // Set up piece-square tables
-    int mg_table[12][64];
-    int eg_table[12][64];
-    init_tables(mg_table, eg_table);
-    // Set up hash tables
+    init_tables();
+    // Set up search reductions
+    init_search();
+    // Set up hash tables (before the board, which needs the hash codes)
     init_zobrist_tables();
     init_hash_table();
+    // Set up board
+    init_board(gs);
+
+    if ((argc > 1) && !strcmp(argv[1], "--bench")) {
+        char *epd_file = (argc > 2) ? argv[2] : BENCH_FILE;
+        int depth = (argc > 3) ? atoi(argv[3]) : BENCH_DEPTH;
+        int failures = bench(epd_file, depth);
+        free(lm);
+        free(ms);
+        free(gs);
+        return failures ? 1 : 0;
+    }
+    if ((argc > 3) && !strcmp(argv[1], "--tune-data")) {
+        int threads = (argc > 4) ? atoi(argv[4]) : 1;
+        int records = export_tuning_data(argv[2], argv[3], threads);
+        free(lm);
+        free(ms);
+        free(gs);
+        return (records < 0) ? 1 : 0;
+    }
+    if ((argc > 2) && !strcmp(argv[1], "--analyze")) {
+        int depth = 0;
+        int threads = 1;
+        for (int i = 3; i + 1 < argc; i += 2) {
+            if (!strcmp(argv[i], "--depth")) {
+                depth = atoi(argv[i + 1]);
+            } else if (!strcmp(argv[i], "--threads")) {
+                threads = atoi(argv[i + 1]);
+            } else if (!strcmp(argv[i], "--hash")) {
+                resize_hash_table(atoi(argv[i + 1]));
+            } else if (!strcmp(argv[i], "--nnue")) {
+                if (nnue_load(argv[i + 1])) {
+                    fprintf(stderr, "Could not load %s\n", argv[i + 1]);
+                    return 1;
+                }
+                nnue_set_enabled(1);
+            }
+        }
+        int positions = analyze_positions(argv[2], depth, threads);
+        free(lm);
+        free(ms);
+        free(gs);
+        return (positions < 0) ? 1 : 0;
+    }
+    if ((argc > 1) && !strcmp(argv[1], "--selfplay")) {
+        int games = selfplay(argc - 2, argv + 2);
+        free(lm);
+        free(ms);
+        free(gs);
+        return (games < 0) ? 1 : 0;
+    }
 
     print_board(gs, lm, do_unicode);
     printf("For all available commands, type '-help'\n");
     printf("To make a legal move, use long algebraic notation: ");
     printf("For example, e2e4 for the e4 opening.\n\n>");
     int flag;
-    while ((flag = parse_input(gs, lm, mg_table, eg_table))) {
+    while ((flag = parse_input(gs, lm))) {
         // Reload board if input requires
         if (flag >= 1) {
             print_board(gs, lm, do_unicode);
@@ -79,15 +146,17 @@ int main() {
             printf("\n");
             // Make computer move
             int start_time = get_time_ms();
-            // int score;
-            int best_move = iterativelyDeepen(
-                gs, mg_table, eg_table,
-                1000); // findBestMove(gs, mg_table, eg_table, 7, &score);
+            search_info info;
+            search_limits limits;
+            fixed_time_limits(&limits, 1000);
+            int best_move = iterativelyDeepen(gs, &limits, &info, NULL);
             int end_time = get_time_ms();
-            makeMove(best_move, gs);
+            makeMove(best_move, gs, NULL);
             // Add to highlight for previous move
             lm->orig_sq = decodeSource(best_move);
             lm->dest_sq = decodeDest(best_move);
+            printf("Looked %i moves ahead (%llu nodes)\n", info.depth,
+                   info.nodes + info.qnodes);
             printf("Thought for %g seconds\n",
                    ((float)end_time - (float)start_time) / 1000);
             print_board(gs, lm, do_unicode);
@@ -100,12 +169,17 @@ int main() {
                 printf("\n");
                 // Make computer move
                 int start_time = get_time_ms();
-                int best_move = iterativelyDeepen(gs, mg_table, eg_table, 1000);
+                search_info info;
+                search_limits limits;
+                fixed_time_limits(&limits, 1000);
+                int best_move = iterativelyDeepen(gs, &limits, &info, NULL);
                 int end_time = get_time_ms();
-                makeMove(best_move, gs);
+                makeMove(best_move, gs, NULL);
                 // Add to highlight for previous move
                 lm->orig_sq = decodeSource(best_move);
                 lm->dest_sq = decodeDest(best_move);
+                printf("Looked %i moves ahead (%llu nodes)\n", info.depth,
+                       info.nodes + info.qnodes);
                 printf("Thought for %g seconds\n",
                        ((float)end_time - (float)start_time) / 1000);
                 print_board(gs, lm, do_unicode);
@@ -120,4 +194,4 @@ int main() {
     free(lm);
     free(ms);
     free(gs);
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "chess.h"
 #include <ctype.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -53,8 +54,17 @@ void parse_position(char *pos, game_state *gs) {
     // First, read to 'position '
     pos += strlen("position ");
     if (!(strncmp("fen", pos, 3))) {
+        // The FEN runs from after "fen " up to the moves, if there are any
+        char fen[256];
+        char *fen_end = strstr(pos, " moves");
+        int length = fen_end ? (int)(fen_end - (pos + 4)) : (int)strlen(pos + 4);
+        if (length > 255) {
+            length = 255;
+        }
+        strncpy(fen, pos + 4, length);
+        fen[length] = '\0';
         // Parse position
-        if (parse_fen(gs, pos)) {
+        if (parse_fen(gs, fen)) {
             // Couldn't parse FEN, just exit (bad behavior)
             exit(1);
         }
@@ -94,24 +104,184 @@ void parse_position(char *pos, game_state *gs) {
 
 /*
 
+While searching, the engine should tell the GUI what it's thinking, via lines
+of the form:
+
+info depth <d> score cp <s> time <ms> nodes <n> nps <n> pv <move1> ...
+
+which we send after every iteration of the deepening. Anything else worth
+knowing (hash table and move ordering statistics) goes in an "info string"
+line, which GUIs show as is.
+
+*/
+
+void print_info(search_info *info) {
+    // Every thread's nodes count
+    U64 nodes = info->nodes + info->qnodes + info->helper_nodes;
+    int ms = info->elapsed_ms > 0 ? info->elapsed_ms : 1;
+    // The line from the root, or at least its best move
+    char pv_string[MAX_PLY * 6 + 1] = "";
+    char move_string[6];
+    if ((info->pv_line_length == 0) && (info->best_move != NULLMOVE)) {
+        moveToString(info->best_move, pv_string);
+    }
+    for (int i = 0; i < info->pv_line_length; i++) {
+        moveToString(info->pv_line[i], move_string);
+        if (i > 0) {
+            strcat(pv_string, " ");
+        }
+        strcat(pv_string, move_string);
+    }
+    // Mates are given in moves (not plies), negative if we're being mated
+    char score_string[20];
+    if (info->score >= MATE_BOUND) {
+        sprintf(score_string, "mate %i", (MATE - info->score + 1) / 2);
+    } else if (info->score <= -MATE_BOUND) {
+        sprintf(score_string, "mate %i", -(MATE + info->score) / 2);
+    } else {
+        sprintf(score_string, "cp %i", info->score);
+    }
+    printf("info depth %i score %s time %i nodes %llu nps %llu hashfull %i "
+           "tbhits %llu%s%s\n",
+           info->depth, score_string, info->elapsed_ms, nodes,
+           nodes * 1000 / ms, hash_table_permill(), info->tb_hits,
+           pv_string[0] ? " pv " : "", pv_string);
+    printf("info string iteration %i ms qnodes %llu tt probes %llu hits %llu "
+           "cutoffs %llu beta cutoffs %llu (%llu%% on first move) pvs "
+           "re-searches %llu aspiration re-searches %llu null cutoffs %llu lmr "
+           "re-searches %llu futility prunes %llu\n",
+           info->iteration_ms, info->qnodes, info->tt_probes, info->tt_hits,
+           info->tt_cutoffs, info->beta_cutoffs,
+           info->beta_cutoffs ? 100 * info->first_move_cutoffs /
+                                    info->beta_cutoffs
+                              : 0,
+           info->pvs_researches, info->aspiration_researches,
+           info->null_cutoffs, info->lmr_researches, info->futility_prunes);
+    fflush(stdout);
+}
+
+/*
+
 The second is "go", which by UCI standards can be followed by many flags, all
-listed below. 
+listed below:
+
+- wtime/btime <ms>, winc/binc <ms>: the clocks and increments, from which the
+  time for this move is worked out (see clock_time_limits)
+- movestogo <n>: moves until the next time control
+- movetime <ms>: exactly this long for this move
+- depth <n>, nodes <n>: only search this deep, or this many nodes
+- infinite: search until told to stop
+- ponder: search on the opponent's time until ponderhit (or stop)
+
+With none of the limits given, we take DEFAULT_MOVE_TIME_MS.
+
+The search runs on a thread of its own, so that the input loop can keep
+answering the GUI meanwhile: "isready" straight away, "stop" by stopping the
+search (which then reports its move), and "ponderhit" by letting a ponder
+search ("go ponder") carry on as a normal one. Only one search runs at a time:
+anything which changes the position or the engine first stops it.
 
 */
 
-void parse_go(char *go, game_state *gs, int mg_table[12][64], int eg_table[12][64]) {
-    // No flags implemented yet
-	go[0] = ' ';// <- Prevent unused warning
-    int best_move = iterativelyDeepen(gs, mg_table, eg_table, 1000);
-    square source_sq = decodeSource(best_move);
-    square dest_sq = decodeDest(best_move);
-	piece promoteTo = decodePromote(best_move);
-    printf("bestmove %s", boardStringMap[source_sq]);
-	printf("%s", boardStringMap[dest_sq]);
-	if (promoteTo != pawn) {
-		printf("%s", pieceStringMap[promoteTo]);
-	}
-    printf("\n");
+#define DEFAULT_MOVE_TIME_MS 1000
+
+static pthread_t search_thread;
+static int searching = 0;
+// The search's own copy of the position (since the GUI may send a new one),
+// and its limits
+static game_state search_gs;
+static search_limits search_lims;
+// Whether to play from the book (see book.c) when it has a move
+static int own_book = 0;
+
+static void *search_worker(void *arg) {
+    search_info info;
+    (void)arg;
+    int best_move =
+        iterativelyDeepen(&search_gs, &search_lims, &info, print_info);
+    // The whole line is printed at once, so that the input thread's replies
+    // (e.g. readyok) can't land in the middle of it
+    char line[32];
+    char move_string[6];
+    // UCI's null move, when there's no legal move to play
+    if (best_move == NULLMOVE) {
+        strcpy(move_string, "0000");
+    } else {
+        moveToString(best_move, move_string);
+    }
+    int length = sprintf(line, "bestmove %s", move_string);
+    // The reply we expect, which the GUI may let us ponder on
+    if ((best_move != NULLMOVE) && (info.pv_line_length > 1) &&
+        (info.pv_line[0] == best_move)) {
+        moveToString(info.pv_line[1], move_string);
+        sprintf(line + length, " ponder %s", move_string);
+    }
+    printf("%s\n", line);
+    fflush(stdout);
+    return NULL;
+}
+
+// Stops the search, if there is one, and waits for it to report its move
+void stop_search_thread() {
+    if (searching) {
+        stop_searching();
+        pthread_join(search_thread, NULL);
+        searching = 0;
+    }
+}
+
+// Reads the number after a flag of go, leaving value alone if the flag isn't
+// there
+static void go_value(char *go, char *flag, int *value) {
+    char *found = strstr(go, flag);
+    if (found) {
+        sscanf(found + strlen(flag), "%i", value);
+    }
+}
+
+void parse_go(char *go, game_state *gs) {
+    stop_search_thread();
+    // An infinite search is a ponder search which never gets a ponderhit
+    int ponder = (strstr(go, "ponder") != NULL) ||
+                 (strstr(go, "infinite") != NULL);
+    // Book moves need no search (but the GUI wants one when pondering or
+    // analysing)
+    int book = (own_book && !ponder) ? book_move(gs) : NULLMOVE;
+    if (book != NULLMOVE) {
+        char move_string[6];
+        moveToString(book, move_string);
+        printf("info string book move\nbestmove %s\n", move_string);
+        fflush(stdout);
+        return;
+    }
+    int time_left = -1;
+    int increment = 0;
+    int moves_to_go = 0;
+    int move_time = -1;
+    int depth = 0;
+    int nodes = 0;
+    go_value(go, gs->whose_turn == WHITE ? "wtime " : "btime ", &time_left);
+    go_value(go, gs->whose_turn == WHITE ? "winc " : "binc ", &increment);
+    go_value(go, "movestogo ", &moves_to_go);
+    go_value(go, "movetime ", &move_time);
+    go_value(go, "depth ", &depth);
+    go_value(go, "nodes ", &nodes);
+    if (move_time >= 0) {
+        move_time_limits(&search_lims, move_time);
+    } else if (time_left >= 0) {
+        clock_time_limits(&search_lims, time_left, increment, moves_to_go);
+    } else if (depth > 0 || nodes > 0) {
+        fixed_time_limits(&search_lims, -1);
+    } else {
+        fixed_time_limits(&search_lims, DEFAULT_MOVE_TIME_MS);
+    }
+    search_lims.depth = depth;
+    search_lims.nodes = nodes;
+    search_gs = *gs;
+    prepare_search(ponder);
+    if (pthread_create(&search_thread, NULL, search_worker, NULL) == 0) {
+        searching = 1;
+    }
 }
 
 // Print move: takes a move and prints as long-algebraic notation. Used for
@@ -128,12 +298,96 @@ void print_move(int move) {
     }
 }
 
+/*
+
+Options are set with "setoption name <id> [value <x>]". We advertise them
+after "uci", for example the hash table size in megabytes as:
+
+option name Hash type spin default 64 min 1 max 65536
+
+EvalFile maps an NNUE network (see nnue.c), which UseNNUE then switches the
+evaluation over to; either way we report whether the network is in use.
+Likewise, with OwnBook on, "go" plays straight from the Polyglot book in
+BookFile when it has a move. SyzygyPath loads the endgame tablebases (see
+syzygy.c).
+
+*/
+#define MAX_HASH_MB 65536
+void print_options() {
+    printf("option name Hash type spin default %i min 1 max %i\n",
+           DEFAULT_HASH_MB, MAX_HASH_MB);
+    printf("option name Threads type spin default 1 min 1 max %i\n",
+           MAX_THREADS);
+    printf("option name EvalFile type string default <empty>\n");
+    printf("option name UseNNUE type check default false\n");
+    printf("option name OwnBook type check default false\n");
+    printf("option name BookFile type string default <empty>\n");
+    printf("option name SyzygyPath type string default <empty>\n");
+}
+
+
+// Whether the evaluation is now the network's, after EvalFile or UseNNUE
+static int use_nnue = 0;
+static void report_nnue(const char *path) {
+    if (nnue_set_enabled(use_nnue)) {
+        printf("info string NNUE evaluation in use (%s kernels)\n",
+               nnue_kernels());
+    } else if (use_nnue) {
+        printf("info string NNUE requested, but no network is loaded\n");
+    } else if (path) {
+        printf("info string loaded network %s (set UseNNUE to use it)\n",
+               path);
+    }
+}
+
+void parse_setoption(char *option) {
+    int megabytes;
+    int threads;
+    if (sscanf(option, "setoption name Hash value %i", &megabytes) == 1) {
+        if (megabytes > MAX_HASH_MB) {
+            megabytes = MAX_HASH_MB;
+        }
+        resize_hash_table(megabytes);
+    } else if (sscanf(option, "setoption name Threads value %i", &threads) ==
+               1) {
+        set_search_threads(threads);
+    } else if (!strncmp(option, "setoption name EvalFile value ", 30)) {
+        char *path = option + 30;
+        path[strcspn(path, "\r\n")] = '\0';
+        if (nnue_load(path)) {
+            printf("info string could not load network %s\n", path);
+        }
+        report_nnue(nnue_loaded() ? path : NULL);
+    } else if (!strncmp(option, "setoption name UseNNUE value ", 29)) {
+        use_nnue = !strncmp(option + 29, "true", 4);
+        report_nnue(NULL);
+    } else if (!strncmp(option, "setoption name OwnBook value ", 29)) {
+        own_book = !strncmp(option + 29, "true", 4);
+    } else if (!strncmp(option, "setoption name BookFile value ", 30)) {
+        char *path = option + 30;
+        path[strcspn(path, "\r\n")] = '\0';
+        if (book_load(path)) {
+            printf("info string could not load book %s\n", path);
+        }
+    } else if (!strncmp(option, "setoption name SyzygyPath value ", 32)) {
+        char *path = option + 32;
+        path[strcspn(path, "\r\n")] = '\0';
+        int pieces = syzygy_init(path);
+        if (pieces < 0) {
+            printf("info string could not load tablebases (built without "
+                   "Syzygy support?)\n");
+        } else {
+            printf("info string found %i-piece tablebases\n", pieces);
+        }
+    }
+}
+
 // main UCI loop
 // Technically, by UCI standards we should ignore garbage preceding a command
 // and ignore any unnecessary whitespace, but we'll assume that commands are
 // always well-formed for now
 #define INPUT_BUFFER 10000
-void uci_loop(game_state *gs, int mg_table[12][64], int eg_table[12][64]) {
+void uci_loop(game_state *gs) {
     // Always use ascii (for windows)
     int do_ascii = 0;
     // reset buffers
@@ -145,12 +399,11 @@ void uci_loop(game_state *gs, int mg_table[12][64], int eg_table[12][64]) {
     // after Понедельник начинается в субботу
     printf("id name Алдан-3\n");
     printf("id name Ben McLemore\n");
+    print_options();
     printf("uciok\n");
 
 	// Set to initial board
 	init_board(gs);
-    // Set up piece-square tables
-    init_tables(mg_table, eg_table);
 
     // main loop : continue until broken
     while (1) {
@@ -158,9 +411,10 @@ void uci_loop(game_state *gs, int mg_table[12][64], int eg_table[12][64]) {
         memset(input, 0, sizeof(input));
         fflush(stdout);
         // get user / GUI input
-        if (!fgets(input, 2000, stdin))
-            // failure to read
-            continue;
+        if (!fgets(input, 2000, stdin)) {
+            // no more input (the GUI is gone), so quit
+            break;
+        }
 
         // no input
         if (input[0] == '\n')
@@ -184,22 +438,45 @@ void uci_loop(game_state *gs, int mg_table[12][64], int eg_table[12][64]) {
 
         // ucinewgame - set up new game board
         else if (strncmp(input, "ucinewgame", 10) == 0) {
+            stop_search_thread();
             init_board(gs);
+            init_hash_table();
+			continue;
+		}
+
+        // setoption - see above, sets engine parameters
+        else if (strncmp(input, "setoption", 9) == 0) {
+            stop_search_thread();
+            parse_setoption(input);
 			continue;
 		}
 
         // position - see above, sets up a position before evaluating
         else if (strncmp(input, "position", 8) == 0) {
+            stop_search_thread();
             parse_position(input, gs);
 			continue;
 		}
 
         // go - see above, begins evaluation based on given flags
         else if (strncmp(input, "go", 2) == 0) {
-            parse_go(input, gs, mg_table, eg_table);
+            parse_go(input, gs);
 			continue;
 		}
 
+        // stop - stop searching, and report the best move found so far
+        else if (strncmp(input, "stop", 4) == 0) {
+            stop_search_thread();
+            continue;
+        }
+
+        // ponderhit - the opponent played the move we were pondering on, so
+        // the search carries on as normal
+        else if (strncmp(input, "ponderhit", 9) == 0) {
+            ponderhit();
+            continue;
+        }
+
         // quit - exit as soon as possible
         else if (strncmp(input, "quit", 4) == 0)
             break;
@@ -209,6 +486,7 @@ void uci_loop(game_state *gs, int mg_table[12][64], int eg_table[12][64]) {
             // print engine info
             printf("id name Алдан-3\n");
             printf("id name Ben McLemore\n");
+            print_options();
             printf("uciok\n");
 			continue;
         }
@@ -223,6 +501,7 @@ void uci_loop(game_state *gs, int mg_table[12][64], int eg_table[12][64]) {
 			continue;
 		}
     }
+    stop_search_thread();
 }
 
 // Main driver code - initializes board and runs uci parser
@@ -230,9 +509,18 @@ void uci_loop(game_state *gs, int mg_table[12][64], int eg_table[12][64]) {
 int main() {
     // Init game memory
     game_state *gs = MALLOC(1, game_state);
-    // Init piece-square tables
-    int mg_table[12][64];
-    int eg_table[12][64];
-    uci_loop(gs, mg_table, eg_table);
+    // Set up magic bitboards (precomputed, so this is fast enough to do
+    // before the GUI's first "uci")
+    init_magic_bitboards();
+    // Set up non-sliding attack tables
+    init_attack_tables();
+    // Set up hash tables
+    init_zobrist_tables();
+    init_hash_table();
+    // Init piece-square tables (before any board is set up)
+    init_tables();
+    // Init search reductions
+    init_search();
+    uci_loop(gs);
 	free(gs);
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "chess.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+  _______________________________________
+ /                                       \
+/   _   _   _                 _   _   _   \
+|  | |_| |_| |   _   _   _   | |_| |_| |  |
+|   \   _   /   | |_| |_| |   \   _   /   |
+|    | | | |     \       /     | | | |    |
+|    | |_| |______|     |______| |_| |    |
+|    |              ___              |    |
+|    |  _    _    (     )    _    _  |    |
+|    | | |  |_|  (       )  |_|  | | |    |
+|    | |_|       |       |       |_| |    |
+|   /            |_______|            \   |
+|  |___________________________________|  |
+\             Computer Chess              /
+ \_______________________________________/
+
+===========================================
+-------------------------------------------
+              BATCH ANALYSIS
+-------------------------------------------
+===========================================
+
+Analyzing a whole database of positions through the UCI interface means one
+position and one search thread at a time, with the GUI's overhead on each. In
+batch mode (./aldan --analyze <file> [--depth N] [--threads T] [--hash MB])
+the engine reads the positions itself and searches T of them at once, each
+worker thread with its own position and search_info, all sharing the hash
+table as the Lazy SMP helpers do (see search.c). With more than one thread the
+exact node counts then depend on what the others stored, as they do for a
+multithreaded search. Taking each position ages the table, as a new search
+does, so that deep entries from positions already done don't crowd out the
+ones being searched.
+
+Each line of the file is an EPD or FEN position (see parse_epd), searched to
+a fixed depth (search_to_depth). Results are printed as soon as each search
+finishes, so not necessarily in the file's order, one JSON object per line:
+
+{"line":3,"fen":"...","depth":10,"bestmove":"e2e4","score":{"cp":25},
+ "nodes":123456,"time_ms":250,"pv":"e2e4 e7e5"}
+
+The line number counts from 1, the score is for the side to move, in
+centipawns or {"mate":n} (in moves, negative if being mated), and a position
+without legal moves has a null bestmove (and a score of mate 0 or cp 0). Lines
+which aren't positions, or are illegal ones the search can't be trusted with,
+give {"line":n,"error":"..."} instead.
+
+*/
+
+#define ANALYZE_DEPTH 10
+// Room for one result line: the position, its pv and the rest
+#define ANALYZE_OUTPUT (MAX_PLY * 6 + EPD_LINE + 200)
+
+typedef struct analyzeWorker_t {
+    FILE *input;        // Shared by all threads, read under input_lock
+    int *line_number;   // Lines read so far, also under input_lock
+    int depth;          // Depth to search every position to
+    search_info *info;  // This thread's own search info
+    U64 nodes;          // Nodes this thread has searched
+    int positions;      // Positions this thread has searched
+} analyze_worker;
+
+static pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Takes the next position's line from the file, returning its line number, or
+// 0 at the end of the file
+static int nextLine(analyze_worker *worker, char line[EPD_LINE]) {
+    int number = 0;
+    pthread_mutex_lock(&input_lock);
+    while (fgets(line, EPD_LINE, worker->input)) {
+        (*worker->line_number)++;
+        // Skip comments and blank lines
+        if ((line[0] != '#') && !isspace(line[0])) {
+            number = *worker->line_number;
+            age_hash_table();
+            break;
+        }
+    }
+    pthread_mutex_unlock(&input_lock);
+    return number;
+}
+
+// Formats a score as a JSON object, as print_info does for UCI
+static void scoreString(int score, char *output) {
+    if (score >= MATE_BOUND) {
+        sprintf(output, "{\"mate\":%i}", (MATE - score + 1) / 2);
+    } else if (score <= -MATE_BOUND) {
+        sprintf(output, "{\"mate\":%i}", -(MATE + score) / 2);
+    } else {
+        sprintf(output, "{\"cp\":%i}", score);
+    }
+}
+
+// Searches one line's position, formatting the result as a line of JSON
+static void analyzeLine(analyze_worker *worker, char *line, int number,
+                        char *output) {
+    game_state gs;
+    char *rest = parse_epd(&gs, line);
+    if (!rest) {
+        sprintf(output, "{\"line\":%i,\"error\":\"could not parse position\"}",
+                number);
+        return;
+    }
+    if (!position_is_legal(&gs)) {
+        sprintf(output, "{\"line\":%i,\"error\":\"illegal position\"}",
+                number);
+        return;
+    }
+    // The position as given, without what follows it
+    while ((rest > line) && isspace(rest[-1])) {
+        rest--;
+    }
+    *rest = '\0';
+    char *fen = line + strspn(line, " \t");
+    char score_string[32];
+    char pv_string[MAX_PLY * 6 + 1] = "";
+    search_info *info = worker->info;
+    moves move_list;
+    generateLegalMoves(&move_list, &gs);
+    if (move_list.count == 0) {
+        clear_search_info(info);
+        scoreString(inCheck(&gs) ? -MATE : 0, score_string);
+        sprintf(output,
+                "{\"line\":%i,\"fen\":\"%s\",\"depth\":0,\"bestmove\":null,"
+                "\"score\":%s,\"nodes\":0,\"time_ms\":0,\"pv\":\"\"}",
+                number, fen, score_string);
+        return;
+    }
+    search_limits limits;
+    fixed_depth_limits(&limits, worker->depth, 0);
+    search_to_depth(&gs, &limits, NULL, info);
+    U64 nodes = info->nodes + info->qnodes;
+    worker->nodes += nodes;
+    worker->positions++;
+    char move_string[6];
+    for (int i = 0; i < info->pv_line_length; i++) {
+        moveToString(info->pv_line[i], move_string);
+        if (i) {
+            strcat(pv_string, " ");
+        }
+        strcat(pv_string, move_string);
+    }
+    moveToString(info->best_move, move_string);
+    scoreString(info->score, score_string);
+    sprintf(output,
+            "{\"line\":%i,\"fen\":\"%s\",\"depth\":%i,\"bestmove\":\"%s\","
+            "\"score\":%s,\"nodes\":%llu,\"time_ms\":%i,\"pv\":\"%s\"}",
+            number, fen, info->depth, move_string, score_string, nodes,
+            info->elapsed_ms, pv_string);
+}
+
+static void *analyzeWorker(void *arg) {
+    analyze_worker *worker = (analyze_worker *)arg;
+    char line[EPD_LINE];
+    char output[ANALYZE_OUTPUT];
+    int number;
+    while ((number = nextLine(worker, line))) {
+        analyzeLine(worker, line, number, output);
+        // Whole lines at a time, straight away
+        pthread_mutex_lock(&output_lock);
+        printf("%s\n", output);
+        fflush(stdout);
+        pthread_mutex_unlock(&output_lock);
+    }
+    return NULL;
+}
+
+int analyze_positions(char *input_file, int depth, int threads) {
+    FILE *input = fopen(input_file, "r");
+    if (!input) {
+        fprintf(stderr, "Could not open %s\n", input_file);
+        return -1;
+    }
+    if (depth < 1) {
+        depth = ANALYZE_DEPTH;
+    }
+    if (depth >= MAX_PLY) {
+        depth = MAX_PLY - 1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+    int line_number = 0;
+    analyze_worker *workers = MALLOC(threads, analyze_worker);
+    pthread_t *handles = MALLOC(threads, pthread_t);
+    int start_ms = get_time_ms();
+    for (int t = 0; t < threads; t++) {
+        workers[t].input = input;
+        workers[t].line_number = &line_number;
+        workers[t].depth = depth;
+        workers[t].info = MALLOC(1, search_info);
+        workers[t].nodes = 0;
+        workers[t].positions = 0;
+        pthread_create(&handles[t], NULL, analyzeWorker, &workers[t]);
+    }
+    U64 nodes = 0;
+    int positions = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(handles[t], NULL);
+        nodes += workers[t].nodes;
+        positions += workers[t].positions;
+        free(workers[t].info);
+    }
+    fclose(input);
+    // The totals go to stderr, leaving stdout as nothing but results
+    int elapsed_ms = get_time_ms() - start_ms;
+    fprintf(stderr, "Analyzed %i positions: %llu nodes in %i ms (%llu nps)\n",
+            positions, nodes, elapsed_ms,
+            nodes * 1000 / (elapsed_ms > 0 ? elapsed_ms : 1));
+    free(handles);
+    free(workers);
+    return positions;
+}
@@ -0,0 +1,199 @@
+#include "chess.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+  _______________________________________
+ /                                       \
+/   _   _   _                 _   _   _   \
+|  | |_| |_| |   _   _   _   | |_| |_| |  |
+|   \   _   /   | |_| |_| |   \   _   /   |
+|    | | | |     \       /     | | | |    |
+|    | |_| |______|     |______| |_| |    |
+|    |              ___              |    |
+|    |  _    _    (     )    _    _  |    |
+|    | | |  |_|  (       )  |_|  | | |    |
+|    | |_|       |       |       |_| |    |
+|   /            |_______|            \   |
+|  |___________________________________|  |
+\             Computer Chess              /
+ \_______________________________________/
+
+===========================================
+-------------------------------------------
+                BENCHMARK
+-------------------------------------------
+===========================================
+
+To know whether a change made the engine faster (or broke it), we need a
+number we can compare between builds. The benchmark reads a fixed set of
+positions from an EPD file (bench.epd), and for each one:
+
+- Runs perft to every depth annotated on the line (";D5 4865609" means perft
+  at depth 5 should find 4865609 leaves), checking the counts. These are
+  well-known test positions, chosen to cover castling, en-passant and
+  promotion edge cases.
+- Runs a fixed-depth findBestMove search from a cleared hash table.
+
+Then it prints the totals: perft nodes and speed, search nodes and speed, and
+the "signature", the total number of search nodes. The signature only changes
+when the search itself changes, so it tells us whether a supposedly pure
+speedup changed the search, while the speeds tell us how fast it went.
+
+The speeds don't say where the time goes, and gprof (make aldanprofile) only
+says it function by function, for a build whose inlining differs. So a build
+with -DPROFILE_PHASES=1 (make aldanphases) also counts the CPU cycles, and
+calls, of each phase of the search: move generation, making and unmaking
+moves, evaluation and hash table probes. These are counted over the bench's
+searches alone (not its perfts), and printed with their share of the searches'
+cycles (the rest being the search itself: move ordering, pruning and so on).
+Reading the counter costs a few dozen cycles, which the phases with the most
+calls feel most, so the shares are a guide rather than exact.
+
+*/
+
+#define BENCH_LINE 1000
+
+#if PROFILE_PHASES
+phase_profile profile_counters;
+
+#if !defined(__x86_64__) && !defined(__i386__)
+U64 profile_cycles() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (U64)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+#endif
+
+static const char *phase_names[PHASE_COUNT] = {"Move generation",
+                                               "Make/unmake", "Evaluation",
+                                               "Hash probes"};
+
+// Prints each phase's cycles, calls, and share of all the searches' cycles
+static void printPhaseProfile(phase_profile *profile, U64 total_cycles,
+                              int search_ms) {
+    printf("\n===========================================\n");
+    printf("Search cycles\t:\t%llu\t:\t%llu per ms\n", total_cycles,
+           total_cycles / (search_ms > 0 ? search_ms : 1));
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        U64 calls = profile->calls[phase];
+        printf("%-16s:\t%llu cycles\t:\t%llu calls\t:\t%llu per call\t:\t"
+               "%.1f%%\n",
+               phase_names[phase], profile->cycles[phase], calls,
+               profile->cycles[phase] / (calls > 0 ? calls : 1),
+               100.0 * profile->cycles[phase] /
+                   (total_cycles > 0 ? total_cycles : 1));
+    }
+}
+#endif
+
+int bench(char *epd_file, int depth) {
+    FILE *epd = fopen(epd_file, "r");
+    if (!epd) {
+        printf("Could not open %s\n", epd_file);
+        return -1;
+    }
+    game_state gs;
+    char line[BENCH_LINE];
+    int positions = 0;
+    int failures = 0;
+    U64 perft_nodes = 0;
+    U64 search_nodes = 0;
+    int perft_ms = 0;
+    int search_ms = 0;
+#if PROFILE_PHASES
+    phase_profile search_profile;
+    memset(&search_profile, 0, sizeof(search_profile));
+    U64 search_cycles = 0;
+#endif
+    while (fgets(line, BENCH_LINE, epd)) {
+        // Skip comments and blank lines
+        if ((line[0] == '#') || isspace(line[0])) {
+            continue;
+        }
+        // The FEN is everything before the first annotation
+        char *annotations = strchr(line, ';');
+        if (annotations) {
+            *annotations = '\0';
+            annotations++;
+        }
+        if (parse_fen(&gs, line)) {
+            printf("Could not parse FEN: %s\n", line);
+            failures++;
+            continue;
+        }
+        positions++;
+        printf("Position %i: %s\n", positions, line);
+        // Perft checks
+        while (annotations) {
+            int perft_depth;
+            U64 expected;
+            if (sscanf(annotations, " D%d %llu", &perft_depth, &expected) == 2) {
+                int start_ms = get_time_ms();
+                U64 count = perft(perft_depth, &gs, 0);
+                int elapsed_ms = get_time_ms() - start_ms;
+                perft_nodes += count;
+                perft_ms += elapsed_ms;
+                printf("\tperft %i\t:\t%llu\t:\t%i ms\t:\t%s\n", perft_depth,
+                       count, elapsed_ms, count == expected ? "ok" : "FAILED");
+                if (count != expected) {
+                    printf("\t\t(expected %llu)\n", expected);
+                    failures++;
+                }
+            }
+            annotations = strchr(annotations, ';');
+            if (annotations) {
+                annotations++;
+            }
+        }
+        // Fixed-depth search, from an empty hash table so that every run
+        // searches the same tree
+        if (depth > 0) {
+            int score;
+            char move_string[6];
+            search_info info;
+            init_hash_table();
+            clear_search_info(&info);
+            int start_ms = get_time_ms();
+#if PROFILE_PHASES
+            memset(&profile_counters, 0, sizeof(profile_counters));
+            U64 start_cycles = profile_cycles();
+#endif
+            int best_move = findBestMove(&gs, depth, &score, &info);
+            int elapsed_ms = get_time_ms() - start_ms;
+#if PROFILE_PHASES
+            search_cycles += profile_cycles() - start_cycles;
+            for (int phase = 0; phase < PHASE_COUNT; phase++) {
+                search_profile.cycles[phase] += profile_counters.cycles[phase];
+                search_profile.calls[phase] += profile_counters.calls[phase];
+            }
+#endif
+            U64 nodes_searched = info.nodes + info.qnodes;
+            search_nodes += nodes_searched;
+            search_ms += elapsed_ms;
+            moveToString(best_move, move_string);
+            printf("\tsearch %i\t:\t%llu nodes\t:\t%i ms\t:\t%s (%i)\n", depth,
+                   nodes_searched, elapsed_ms, move_string, score);
+        }
+    }
+    fclose(epd);
+    printf("\n===========================================\n");
+    printf("Positions\t:\t%i\n", positions);
+    printf("Perft nodes\t:\t%llu\t:\t%i ms\t:\t%llu nps\n", perft_nodes,
+           perft_ms, perft_nodes * 1000 / (perft_ms > 0 ? perft_ms : 1));
+    printf("Search nodes\t:\t%llu\t:\t%i ms\t:\t%llu nps\n", search_nodes,
+           search_ms, search_nodes * 1000 / (search_ms > 0 ? search_ms : 1));
+    printf("Signature\t:\t%llu\n", search_nodes);
+    if (failures) {
+        printf("FAILED %i perft checks\n", failures);
+    } else {
+        printf("All perft checks passed\n");
+    }
+#if PROFILE_PHASES
+    printPhaseProfile(&search_profile, search_cycles, search_ms);
+#endif
+    return failures;
+}
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 /*
   _______________________________________
@@ -111,6 +112,24 @@ void init_board(game_state *gs) {
     gs->halfmove_counter = 0;
     gs->moves = 0;
     gs->castling = 0b1111;
+    init_mailbox(gs);
+    gs->hash = current_pos_hash(gs);
+    gs->pawn_hash = current_pawn_hash(gs);
+    init_eval(gs);
+}
+
+// Fills in which piece stands on every square from the bitboards
+void init_mailbox(game_state *gs) {
+    for (square sq = h1; sq <= a8; sq++) {
+        gs->board[sq] = NO_PIECE;
+    }
+    for (int i = 0; i < 12; i++) {
+        U64 bb = gs->piece_bb[i];
+        while (bb) {
+            gs->board[bbToSq(bb)] = i;
+            bb &= bb - 1;
+        }
+    }
 }
 
 // Set the bitboards to 0 before entering FEN information
@@ -446,27 +465,63 @@ U64 enPassantAttacks(U64 pawn_bb, int color, U64 enPassantSq) {
     }
 }
 
-// Lastly, a "taboo" bitboard. This is equivalent to every attack
-// made by the OPPOSITE color, to see where the current color's king is
-// forbidden from moving, used for castling: the king cannot castle through
-// "taboo" squares
-U64 tabooBoard(game_state *gs) {
-    int color = gs->whose_turn;
-    int foe = 1 - color;
-    U64 empt = ~gs->all_bb;
-    // Find all attacks
-    U64 pawn_attacks;
-    if (color) {
-        pawn_attacks = wpAttacks(gs->piece_bb[2 * pawn + foe]);
-    } else {
-        pawn_attacks = bpAttacks(gs->piece_bb[2 * pawn + foe]);
+/*
+
+Lastly, lookup tables for the non-sliding pieces. The attack functions above
+work on whole bitboards at once, which is what we want for masks and
+evaluation, but when we ask about a single square it is cheaper to precompute
+the answer for every square once and just index into a table, exactly like the
+magic bitboards do for the sliders.
+
+*/
+
+U64 knightAttackTable[64];
+U64 kingAttackTable[64];
+// Indexed by the color of the pawn, then its square
+U64 pawnAttackTable[2][64];
+
+void init_attack_tables() {
+    for (square sq = h1; sq <= a8; sq++) {
+        U64 sq_bb = (U64)1 << sq;
+        knightAttackTable[sq] = knightAttacks(sq_bb);
+        kingAttackTable[sq] = kingAttacks(sq_bb);
+        pawnAttackTable[WHITE][sq] = wpAttacks(sq_bb);
+        pawnAttackTable[BLACK][sq] = bpAttacks(sq_bb);
     }
-    U64 knight_attacks = knightAttacks(gs->piece_bb[2 * knight + foe]);
-    U64 bishop_attacks = bishopAttacks(gs->piece_bb[2 * bishop + foe], empt);
-    U64 rook_attacks = rookAttacks(gs->piece_bb[2 * rook + foe], empt);
-    U64 queen_attacks = queenAttacks(gs->piece_bb[2 * queen + foe], empt);
-    U64 king_attacks = kingAttacks(gs->piece_bb[2 * king + foe]);
-    return (pawn_attacks | knight_attacks | bishop_attacks | rook_attacks | queen_attacks | king_attacks);
+    // Lines between squares, for legal move generation (see below)
+    init_line_tables();
+}
+
+/*
+
+With the tables, asking whether a square is attacked is easiest done
+"backwards": from the square itself, we look outward as if it held each kind
+of piece. A knight on the square attacks exactly the squares a knight could
+attack it from, and the same holds for every other piece (pawns excepted,
+which have to look in the opposite direction). So we only need a handful of
+lookups and bitwise &'s, rather than generating every attack of the attacker.
+
+*/
+
+// Returns whether the given square is attacked by any piece of the given color
+int isSquareAttacked(game_state *gs, square sq, int attacker) {
+    if (pawnAttackTable[1 - attacker][sq] & gs->piece_bb[2 * pawn + attacker]) {
+        return 1;
+    }
+    if (knightAttackTable[sq] & gs->piece_bb[2 * knight + attacker]) {
+        return 1;
+    }
+    if (kingAttackTable[sq] & gs->piece_bb[2 * king + attacker]) {
+        return 1;
+    }
+    U64 queens = gs->piece_bb[2 * queen + attacker];
+    if (magicBishopAttacks(sq, gs->all_bb) & (gs->piece_bb[2 * bishop + attacker] | queens)) {
+        return 1;
+    }
+    if (magicRookAttacks(sq, gs->all_bb) & (gs->piece_bb[2 * rook + attacker] | queens)) {
+        return 1;
+    }
+    return 0;
 }
 
 /*
@@ -489,6 +544,11 @@ every legal move in a 4-byte int
 Moves are generated by taking every piece in every bitboard and finding every square it attacks, then encoding
 the move and appending to the movelist
 
+The search keeps the moves it hasn't tried yet in only 16 bits each: the same source and target squares, and the
+promoted piece in the top 4 bits. Everything else follows from the position the move is played in (the mailbox
+gives the moving and captured pieces, and how far a pawn or king travels gives the remaining flags), so
+expandMove rebuilds the full move when it is handed out.
+
 */
 
 // Converts bb w/ 1 piece to its square (counts trailing zeros w/ GCC builtin)
@@ -569,12 +629,142 @@ piece decodeCapturedPiece(int move) {
     return ((move >> 25) & 0b1111);
 }
 
+// Packs a move into its compact 16 bits
+int compactMove(int move) {
+    return (move & 0xfff) | (decodePromote(move) << 12);
+}
+
+// Rebuilds the full move from its compact form, in the position it is to be
+// played in
+int expandMove(game_state *gs, int compact) {
+    int source_sq = decodeSource(compact);
+    int dest_sq = decodeDest(compact);
+    piece piec = gs->board[source_sq] / 2;
+    int captured = gs->board[dest_sq];
+    int distance = abs(dest_sq - source_sq);
+    int captureBit = (captured != NO_PIECE);
+    int doubleBit = (piec == pawn) && (distance == 16);
+    // A pawn moving diagonally onto an empty square
+    int enPassantBit = (piec == pawn) && !captureBit && (distance != 8) && (distance != 16);
+    int castleBit = (piec == king) && (distance == 2);
+    piece capturedPiec = captureBit ? captured / 2 : pawn;
+    return ((compact & 0xfff) | (piec << 12) | (((compact >> 12) & 0b1111) << 16) | (captureBit << 20) |
+        (doubleBit << 21) | (enPassantBit << 22) | (castleBit << 23) | (gs->whose_turn << 24) | (capturedPiec << 25));
+}
+
 // Add a move to the movelist
 void addMove(moves *move_list, int move) {  
     move_list->moves[move_list->count] = move;
     move_list->count++;
 }
 
+// Encodes and adds every move of a single piece, given its attacked squares
+// (with friendly-fire already removed). Castling destinations are expected to
+// already be legal
+static void addPieceMoves(moves *moveList, game_state *gs, piece piec, U64 source_bb, U64 attacks_bb) {
+    int move;
+    U64 currAttack_bb;
+    int color = gs->whose_turn;
+    U64 turnFlag = (U64)color;
+    int foe = 1 - color;
+    // Flags for encoding later
+    U64 captureFlag, doubleFlag, enPassantFlag, castleFlag;
+    piece promoteTo;
+    piece capturedPiec;
+    // Iter thru possible squares:
+    while (attacks_bb) {
+        // Get current attack (LSB)
+        currAttack_bb = attacks_bb & -attacks_bb;
+        // Remove LSB from piece bitboard
+        attacks_bb = attacks_bb & (attacks_bb - 1);
+        // Check whether this is an attack
+        captureFlag = (currAttack_bb & gs->color_bb[foe]);
+        // If not a capture, these bits are left as pawn (0), so that the same
+        // move is always encoded the same way (moves are compared as ints)
+        capturedPiec = pawn;
+        if (captureFlag) {
+            // In this case, the mailbox tells us which piece is being captured
+            capturedPiec = gs->board[bbToSq(currAttack_bb)] / 2;
+        }
+        // Check whether we've double-moved a pawn
+        doubleFlag = (((currAttack_bb << 16 & source_bb) || (currAttack_bb >> 16 & source_bb)) & (!piec));
+        // Check whether we've en-passant captures
+        enPassantFlag = (gs->en_passant & currAttack_bb) && (!piec);
+        // Check whether castling
+        castleFlag = (((currAttack_bb << 2 & source_bb) || (currAttack_bb >> 2 & source_bb)) && (piec == king));
+        // Check whether we've moved a pawn up to the last rank (can use bitwise OR since pawns can only
+        // get to one of the last ranks)
+        promoteTo = pawn; // <- equivalent to no promotion
+        U64 promoteFlag = ((!piec) & ((0b11111111 & currAttack_bb) || (((U64)0b11111111 << 56) & currAttack_bb)));
+        if (promoteFlag) {
+            // If we have, then encode every promotion
+            for (promoteTo = knight; promoteTo < king; promoteTo++) {
+                move = encodeMove(source_bb, currAttack_bb, piec, promoteTo, captureFlag, doubleFlag, enPassantFlag, 
+                    castleFlag, turnFlag, capturedPiec);
+                addMove(moveList, move);
+            }
+        } else {
+            // Add the move
+            move = encodeMove(source_bb, currAttack_bb, piec, promoteTo, captureFlag, doubleFlag, enPassantFlag,
+                castleFlag, turnFlag, capturedPiec);
+            addMove(moveList, move);
+        }
+    }
+}
+
+// Adds every move of a single piece in compact form, which only needs the
+// squares (and each promotion)
+static void addCompactMoves(compact_moves *move_list, piece piec, U64 source_bb, U64 attacks_bb) {
+    int source_sq = bbToSq(source_bb);
+    U64 promotionRanks = (U64)0xFF | ((U64)0xFF << 56);
+    while (attacks_bb) {
+        int move = source_sq | (bbToSq(attacks_bb) << 6);
+        U64 dest_bb = attacks_bb & -attacks_bb;
+        attacks_bb &= attacks_bb - 1;
+        if ((piec == pawn) && (dest_bb & promotionRanks)) {
+            for (piece promoteTo = knight; promoteTo < king; promoteTo++) {
+                move_list->moves[move_list->count++] = move | (promoteTo << 12);
+            }
+        } else {
+            move_list->moves[move_list->count++] = move;
+        }
+    }
+}
+
+// Returns the destination squares of every legal castling move for the king
+// on source_bb
+static U64 castlingAttacks(game_state *gs, U64 source_bb) {
+    int color = gs->whose_turn;
+    int foe = 1 - color;
+    square source_sq = bbToSq(source_bb);
+    U64 castles_bb = 0;
+    // If the king is still permitted to castle, check legality of each side
+    U64 sides[2] = {
+        // Kingside, then queenside
+        (gs->castling & (1 << (2 * foe + 1))) ? ((source_bb >> 2) & notGH) : 0,
+        (gs->castling & (1 << (2 * foe))) ? ((source_bb << 2) & notAB) : 0
+    };
+    for (int direction = 0; direction < 2; direction++) {
+        U64 dest_bb = sides[direction];
+        if (!dest_bb) {
+            continue;
+        }
+        // First, whether the rook can capture the king
+        square which_rook_sq = 7 * direction + 56 * color;
+        U64 rook_captures = magicRookAttacks(which_rook_sq, gs->all_bb) & source_bb;
+        // Next, whether the king would ever be in check
+        U64 intermediate_sq = (source_bb > dest_bb ? source_bb : dest_bb) >> 1;
+        // Failing any check will skip adding the move
+        if (!rook_captures || isSquareAttacked(gs, source_sq, foe) ||
+            isSquareAttacked(gs, bbToSq(intermediate_sq), foe) ||
+            isSquareAttacked(gs, bbToSq(dest_bb), foe)) {
+            continue;
+        }
+        castles_bb |= dest_bb;
+    }
+    return castles_bb;
+}
+
 // Generate all moves (lots of branching)
 void generateAllMoves(moves *moveList, game_state *gs) {
     //
@@ -582,22 +772,16 @@ void generateAllMoves(moves *moveList, game_state *gs) {
     //
     // Reset move count (no need to reset list)
     moveList->count = 0;
-    int move;
     // Bitboard holding current pieces, bitboard holding ONLY ONE current piece, and 
-    // bitboard containing its legal moves/attacks (if any), bitboard containing ONE attack
-    U64 piece_bb, source_bb, attacks_bb, currAttack_bb;
+    // bitboard containing its legal moves/attacks (if any)
+    U64 piece_bb, source_bb, attacks_bb;
     square source_sq;
     int color = gs->whose_turn;
-    U64 turnFlag = (U64)color;
     int foe = 1 - color;
     // Emptiness (non-occupancy) bitboard for sliding attacks
     U64 empt = ~gs->all_bb;
     // Mask to remove attacks on the same color
     U64 friendlyFireMask = ~gs->color_bb[color];
-    // Flags for encoding later
-    U64 captureFlag, doubleFlag, enPassantFlag, castleFlag;
-    piece promoteTo;
-    piece capturedPiec = pawn;
     //
     // Generating ordinary moves
     //
@@ -637,86 +821,44 @@ void generateAllMoves(moves *moveList, game_state *gs) {
                     break;
                 case king:
                     // If the king is still permitted to castle, add to available moves
-                    // (legality check later, before adding to movelist)
-                    U64 kingside_castle = (gs->castling & (1 << (2 * foe + 1)));
-                    U64 queenside_castle = (gs->castling & (1 << (2 * foe)));
-                    attacks_bb = kingAttacks(source_bb);
-                    if (kingside_castle) {
-                        attacks_bb |= ((source_bb >> 2) & notGH);
-                    }
-                    if (queenside_castle) {
-                        attacks_bb |= ((source_bb << 2) & notAB);
-                    }
+                    // (legality checked before adding)
+                    attacks_bb = kingAttacks(source_bb) | castlingAttacks(gs, source_bb);
                     break;
             }
             // Turn off friendly-fire
             attacks_bb &= friendlyFireMask;
-            // Iter thru possible squares:
-            while (attacks_bb) {
-                // Get current attack (LSB)
-                currAttack_bb = attacks_bb & -attacks_bb;
-                // Remove LSB from piece bitboard
-                attacks_bb = attacks_bb & (attacks_bb - 1);
-                // Check whether this is an attack
-                captureFlag = (currAttack_bb & gs->color_bb[foe]);
-                if (captureFlag) {
-                    // If not a capture, we don't use these bits, so no need to reinitialize;
-                    // just leave as garbage
-                    // In this case, need to find which piece is being captured
-                    for (piece p = pawn; p <= king; p++) {
-                        if (gs->piece_bb[2 * p + foe] & currAttack_bb) {
-                            capturedPiec = p;
-                            break;
-                        }
-                    }
-                }
-                // Check whether we've double-moved a pawn
-                doubleFlag = (((currAttack_bb << 16 & source_bb) || (currAttack_bb >> 16 & source_bb)) & (!piec));
-                // Check whether we've en-passant captures
-                enPassantFlag = (gs->en_passant & currAttack_bb) && (!piec);
-                // Check whether castling
-                castleFlag = (((currAttack_bb << 2 & source_bb) || (currAttack_bb >> 2 & source_bb)) && (piec == king));
-                if (castleFlag) {
-                    // Check legality of castling before adding move:
-                    // First, whether the rook can capture the king
-                    int direction = !!((currAttack_bb >> 2) & source_bb);
-                    U64 which_rook_bb = ((U64)1 << (7 * direction + 56 * color));
-                    U64 rook_captures = rookAttacks(which_rook_bb, empt) & source_bb;
-                    // Next, whether the king would ever be in check
-                    U64 taboo = tabooBoard(gs);
-                    U64 start_check = source_bb & taboo;
-                    U64 intermediate_sq = (source_bb > currAttack_bb ? source_bb : currAttack_bb) >> 1;
-                    U64 intermediate_check = intermediate_sq & taboo & friendlyFireMask;
-                    U64 ends_check = currAttack_bb & taboo;
-                    // Failing any check will skip adding the move
-                    if (!rook_captures || start_check || intermediate_check || ends_check) {
-                        continue;
-                    }
-                }
-                // Check whether we've moved a pawn up to the last rank (can use bitwise OR since pawns can only
-                // get to one of the last ranks)
-                promoteTo = pawn; // <- equivalent to no promotion
-                U64 promoteFlag = ((!piec) & ((0b11111111 & currAttack_bb) || (((U64)0b11111111 << 56) & currAttack_bb)));
-                if (promoteFlag) {
-                    // If we have, then encode every promotion
-                    for (promoteTo = knight; promoteTo < king; promoteTo++) {
-                        move = encodeMove(source_bb, currAttack_bb, piec, promoteTo, captureFlag, doubleFlag, enPassantFlag, 
-                            castleFlag, turnFlag, capturedPiec);
-                        addMove(moveList, move);
-                    }
-                } else {
-                    // Add the move
-                    move = encodeMove(source_bb, currAttack_bb, piec, promoteTo, captureFlag, doubleFlag, enPassantFlag,
-                        castleFlag, turnFlag, capturedPiec);
-                    addMove(moveList, move);
-                }
-            }
+            addPieceMoves(moveList, gs, piec, source_bb, attacks_bb);
         }
     }
 }
 
-// Make a move
-void makeMove(int move, game_state *gs) {
+/*
+
+Making a move only changes a few bitboards, and the move itself tells us
+which: the source and destination, the piece moved, the piece captured, and
+whether it was a promotion, an en-passant capture, or castling. So to take a
+move back we just apply the same changes in reverse, instead of copying the
+whole game_state before every move.
+
+The only things the move can't tell us are the castling rights, the
+en-passant square, and the halfmove counter from before it was made, which
+makeMove saves into a small undo_info. Each ply of a search keeps its own
+undo_info on the stack.
+
+*/
+
+// Make a move. If undo isn't NULL, saves what is needed to take it back
+void makeMove(int move, game_state *gs, undo_info *undo) {
+    PROFILE_BEGIN(start);
+    if (undo) {
+        undo->castling = gs->castling;
+        undo->en_passant = gs->en_passant;
+        undo->halfmove_counter = gs->halfmove_counter;
+        undo->hash = gs->hash;
+        undo->pawn_hash = gs->pawn_hash;
+        undo->psqt = gs->psqt;
+        undo->phase = gs->phase;
+    }
     U64 source_bb = (U64)1 << decodeSource(move);
     U64 dest_bb = (U64)1 << decodeDest(move);
     piece piec = decodePiece(move);
@@ -727,9 +869,26 @@ void makeMove(int move, game_state *gs) {
     int castleFlag = decodeCastle(move);
     int color = gs->whose_turn;
     int foe = 1 - color;
+    // The extras change from here on, so take them out of the hash first (they
+    // are put back in at the end)
+    gs->hash ^= castlingCodes[gs->castling];
+    if (gs->en_passant) {
+        gs->hash ^= enpassantCodes[bbToSq(gs->en_passant) % 8];
+    }
     // Move in pieceboard
     gs->piece_bb[2 * piec + color] &= (~source_bb);
     gs->piece_bb[2 * piec + color] |= dest_bb;
+    gs->hash ^= pieceCodes[2 * piec + color][decodeSource(move)] ^
+                pieceCodes[2 * piec + color][decodeDest(move)];
+    gs->psqt += pst[2 * piec + color][decodeDest(move)] -
+                pst[2 * piec + color][decodeSource(move)];
+    if (piec == pawn) {
+        gs->pawn_hash ^= pieceCodes[2 * pawn + color][decodeSource(move)] ^
+                         pieceCodes[2 * pawn + color][decodeDest(move)];
+    }
+    // Move in the mailbox (which also takes off anything captured there)
+    gs->board[decodeSource(move)] = NO_PIECE;
+    gs->board[decodeDest(move)] = 2 * piec + color;
     // Move in own color
     gs->color_bb[color] &= (~source_bb);
     gs->color_bb[color] |= dest_bb;
@@ -744,6 +903,12 @@ void makeMove(int move, game_state *gs) {
         piece capturedPiec = decodeCapturedPiece(move);
         // Update
         gs->piece_bb[(capturedPiec * 2) + foe] &= (~dest_bb);
+        gs->hash ^= pieceCodes[(capturedPiec * 2) + foe][decodeDest(move)];
+        gs->psqt -= pst[(capturedPiec * 2) + foe][decodeDest(move)];
+        gs->phase -= gamephaseInc[(capturedPiec * 2) + foe];
+        if (capturedPiec == pawn) {
+            gs->pawn_hash ^= pieceCodes[(pawn * 2) + foe][decodeDest(move)];
+        }
     }
     // If double pushing, update en-passant square
     if (doubleFlag) {
@@ -766,7 +931,10 @@ void makeMove(int move, game_state *gs) {
         gs->piece_bb[(pawn * 2) + foe] &= (~captured_pawn);
         gs->color_bb[foe] &= (~captured_pawn);
         gs->all_bb &= (~captured_pawn);
-
+        gs->hash ^= pieceCodes[(pawn * 2) + foe][bbToSq(captured_pawn)];
+        gs->pawn_hash ^= pieceCodes[(pawn * 2) + foe][bbToSq(captured_pawn)];
+        gs->psqt -= pst[(pawn * 2) + foe][bbToSq(captured_pawn)];
+        gs->board[bbToSq(captured_pawn)] = NO_PIECE;
     }
     // Check whether castling is possible
     if (gs->castling) {
@@ -783,6 +951,12 @@ void makeMove(int move, game_state *gs) {
             gs->piece_bb[(rook * 2) + color] |= intermediate_sq;
             gs->color_bb[color] |= intermediate_sq;
             gs->all_bb |= intermediate_sq;
+            gs->hash ^= pieceCodes[(rook * 2) + color][bbToSq(which_rook_bb)] ^
+                        pieceCodes[(rook * 2) + color][bbToSq(intermediate_sq)];
+            gs->psqt += pst[(rook * 2) + color][bbToSq(intermediate_sq)] -
+                        pst[(rook * 2) + color][bbToSq(which_rook_bb)];
+            gs->board[bbToSq(which_rook_bb)] = NO_PIECE;
+            gs->board[bbToSq(intermediate_sq)] = (rook * 2) + color;
             // Lastly, update castling array
             gs->castling &= ~((int)0b11 << (2 * foe));
         }
@@ -810,12 +984,34 @@ void makeMove(int move, game_state *gs) {
         gs->piece_bb[2 * pawn + color] &= (~dest_bb);
         // Add to promoted board
         gs->piece_bb[2 * promoteTo + color] |= (dest_bb);
+        gs->hash ^= pieceCodes[2 * pawn + color][decodeDest(move)] ^
+                    pieceCodes[2 * promoteTo + color][decodeDest(move)];
+        gs->psqt += pst[2 * promoteTo + color][decodeDest(move)] -
+                    pst[2 * pawn + color][decodeDest(move)];
+        gs->phase += gamephaseInc[2 * promoteTo + color];
+        gs->pawn_hash ^= pieceCodes[2 * pawn + color][decodeDest(move)];
+        gs->board[decodeDest(move)] = 2 * promoteTo + color;
+    }
+    // Pawn moves and captures reset the 50 move rule
+    if ((piec == pawn) || captureFlag) {
+        gs->halfmove_counter = 0;
+    } else {
+        gs->halfmove_counter += 1;
     }
     // Now, update turns/moves
     if (1 - gs->whose_turn) {
         gs->moves += 1;
     }
     gs->whose_turn = foe;
+    // Put the new extras into the hash
+    gs->hash ^= castlingCodes[gs->castling] ^ endTurnCode;
+    if (gs->en_passant) {
+        gs->hash ^= enpassantCodes[bbToSq(gs->en_passant) % 8];
+    }
+    if (nnue_enabled) {
+        nnue_make_move(gs, move, color);
+    }
+    PROFILE_END(start, PHASE_MAKE_UNMAKE);
 }
 
 /*
@@ -828,7 +1024,7 @@ look at many moves due to alpha-beta pruning, we avoid doing any legality checks
 unnecessarily.
 
 The legality checker really only needs to do one thing: place a "super-piece" on the king's
-square and check if it hits anything. That means our legality checker only does "check" checking,
+square and check if it hits anything (which is exactly isSquareAttacked above). That means our legality checker only does "check" checking,
 not castling or en-passant or anything else, which should be handled in move generation.
 
 This "super-piece" can move like any other piece. If it encounters any piece, we see whether this
@@ -846,69 +1042,454 @@ U64 checkCheck(game_state *gs) {
     int color = gs->whose_turn;
     int foe = 1 - color;
     U64 king_bb = gs->piece_bb[2 * king + foe];
-    // Find empty bitboard for occlusion
-    U64 empt = ~gs->all_bb;
-    // Make all attacks (intersection of attacks w/ king)
-    U64 pawn_attacks;
-    if (color) {
-        pawn_attacks = bpAttacks(gs->piece_bb[2 * pawn + color]);
+    // Look outward from the king for any of our attackers
+    if (isSquareAttacked(gs, bbToSq(king_bb), color)) {
+        return king_bb;
+    }
+    return 0;
+}
+
+// Takes back a move made by makeMove, given the undo_info it saved
+void unmakeMove(int move, game_state *gs, undo_info *undo) {
+    PROFILE_BEGIN(start);
+    U64 source_bb = (U64)1 << decodeSource(move);
+    U64 dest_bb = (U64)1 << decodeDest(move);
+    piece piec = decodePiece(move);
+    piece promoteTo = decodePromote(move);
+    // The turn has already passed to the other player
+    int foe = gs->whose_turn;
+    int color = 1 - foe;
+    // Turns/moves first
+    gs->whose_turn = color;
+    gs->hash = undo->hash;
+    gs->pawn_hash = undo->pawn_hash;
+    gs->psqt = undo->psqt;
+    gs->phase = undo->phase;
+    if (1 - color) {
+        gs->moves -= 1;
+    }
+    // If promoted, turn the piece back into a pawn
+    if (promoteTo) {
+        gs->piece_bb[2 * promoteTo + color] &= (~dest_bb);
+        gs->piece_bb[2 * pawn + color] |= dest_bb;
+    }
+    // Move back in pieceboard, own color, and overall
+    gs->piece_bb[2 * piec + color] &= (~dest_bb);
+    gs->piece_bb[2 * piec + color] |= source_bb;
+    gs->color_bb[color] &= (~dest_bb);
+    gs->color_bb[color] |= source_bb;
+    gs->all_bb &= (~dest_bb);
+    gs->all_bb |= source_bb;
+    gs->board[decodeSource(move)] = 2 * piec + color;
+    gs->board[decodeDest(move)] = NO_PIECE;
+    // If capturing, put the captured piece back
+    if (decodeCapture(move)) {
+        piece capturedPiec = decodeCapturedPiece(move);
+        gs->piece_bb[(capturedPiec * 2) + foe] |= dest_bb;
+        gs->color_bb[foe] |= dest_bb;
+        gs->all_bb |= dest_bb;
+        gs->board[decodeDest(move)] = (capturedPiec * 2) + foe;
+    }
+    // If en-passant, put the captured pawn back
+    if (decodeEnPassant(move)) {
+        U64 captured_pawn;
+        if (color) {
+            captured_pawn = dest_bb << 8;
+        } else {
+            captured_pawn = dest_bb >> 8;
+        }
+        gs->piece_bb[(pawn * 2) + foe] |= captured_pawn;
+        gs->color_bb[foe] |= captured_pawn;
+        gs->all_bb |= captured_pawn;
+        gs->board[bbToSq(captured_pawn)] = (pawn * 2) + foe;
+    }
+    // If castling, move the rook back to its corner
+    if (decodeCastle(move)) {
+        int direction = !!((dest_bb >> 2) & source_bb);
+        U64 which_rook_bb = (U64)1 << (7 * direction + 56 * color);
+        U64 intermediate_sq = (source_bb > dest_bb ? source_bb : dest_bb) >> 1;
+        gs->piece_bb[(rook * 2) + color] &= (~intermediate_sq);
+        gs->color_bb[color] &= (~intermediate_sq);
+        gs->all_bb &= (~intermediate_sq);
+        gs->piece_bb[(rook * 2) + color] |= which_rook_bb;
+        gs->color_bb[color] |= which_rook_bb;
+        gs->all_bb |= which_rook_bb;
+        gs->board[bbToSq(intermediate_sq)] = NO_PIECE;
+        gs->board[bbToSq(which_rook_bb)] = (rook * 2) + color;
+    }
+    if (nnue_enabled) {
+        nnue_unmake_move(gs, move, color);
+    }
+    // Lastly, the extras the move can't tell us
+    gs->castling = undo->castling;
+    gs->en_passant = undo->en_passant;
+    gs->halfmove_counter = undo->halfmove_counter;
+    PROFILE_END(start, PHASE_MAKE_UNMAKE);
+}
+
+// Passes the turn without moving (for null-move pruning in the search): only
+// the turn and any en-passant square change
+void makeNullMove(game_state *gs, undo_info *undo) {
+    undo->castling = gs->castling;
+    undo->en_passant = gs->en_passant;
+    undo->halfmove_counter = gs->halfmove_counter;
+    undo->hash = gs->hash;
+    undo->pawn_hash = gs->pawn_hash;
+    undo->psqt = gs->psqt;
+    undo->phase = gs->phase;
+    if (gs->en_passant) {
+        gs->hash ^= enpassantCodes[bbToSq(gs->en_passant) % 8];
+        gs->en_passant = 0;
+    }
+    gs->hash ^= endTurnCode;
+    gs->halfmove_counter += 1;
+    if (1 - gs->whose_turn) {
+        gs->moves += 1;
+    }
+    gs->whose_turn = 1 - gs->whose_turn;
+}
+
+// Takes back a null move made by makeNullMove
+void unmakeNullMove(game_state *gs, undo_info *undo) {
+    gs->whose_turn = 1 - gs->whose_turn;
+    if (1 - gs->whose_turn) {
+        gs->moves -= 1;
+    }
+    gs->en_passant = undo->en_passant;
+    gs->halfmove_counter = undo->halfmove_counter;
+    gs->hash = undo->hash;
+}
+
+/*
+
+Generating pseudo-legal moves and then testing each one by making it is
+simple, but it means every move is made and taken back once just to find out
+whether it is legal. Instead, we can work out once per position everything
+that makes a move illegal, and only ever generate legal moves:
+
+- Checkers: the enemy pieces giving check. With two checkers, only the king
+  can move. With one, every other move must capture the checker or block it,
+  so we restrict destinations to the "check mask": the checker plus the
+  squares between it and the king.
+- Pins: a piece which is the only one standing between our king and an enemy
+  slider may only move along the line joining them.
+- King moves: the king may not step onto an attacked square. We look at
+  attacks with the king removed from the board, so it can't "hide behind
+  itself" from a slider.
+- En-passant: the rare case where a capture removes two pieces from a rank at
+  once, which pins can't describe. Since it's so rare we just test it directly.
+
+For the masks we need two more tables: the squares between two squares, and
+the full line through them (both empty if they aren't on a shared line).
+
+*/
+
+U64 betweenTable[64][64];
+U64 lineTable[64][64];
+
+// Called from init_attack_tables, and needs the magic bitboards to be
+// initialized first
+void init_line_tables() {
+    for (square sq1 = h1; sq1 <= a8; sq1++) {
+        for (square sq2 = h1; sq2 <= a8; sq2++) {
+            U64 sq1_bb = (U64)1 << sq1;
+            U64 sq2_bb = (U64)1 << sq2;
+            betweenTable[sq1][sq2] = 0;
+            lineTable[sq1][sq2] = 0;
+            if (sq1 == sq2) {
+                continue;
+            }
+            if (magicRookAttacks(sq1, 0) & sq2_bb) {
+                betweenTable[sq1][sq2] = magicRookAttacks(sq1, sq2_bb) & magicRookAttacks(sq2, sq1_bb);
+                lineTable[sq1][sq2] = (magicRookAttacks(sq1, 0) & magicRookAttacks(sq2, 0)) | sq1_bb | sq2_bb;
+            } else if (magicBishopAttacks(sq1, 0) & sq2_bb) {
+                betweenTable[sq1][sq2] = magicBishopAttacks(sq1, sq2_bb) & magicBishopAttacks(sq2, sq1_bb);
+                lineTable[sq1][sq2] = (magicBishopAttacks(sq1, 0) & magicBishopAttacks(sq2, 0)) | sq1_bb | sq2_bb;
+            }
+        }
+    }
+}
+
+// Returns every piece of the attacking color which attacks the square, given
+// an occupancy for the sliders to be blocked by
+U64 attackersTo(game_state *gs, square sq, int attacker, U64 occupancy) {
+    U64 queens = gs->piece_bb[2 * queen + attacker];
+    return (pawnAttackTable[1 - attacker][sq] & gs->piece_bb[2 * pawn + attacker]) |
+           (knightAttackTable[sq] & gs->piece_bb[2 * knight + attacker]) |
+           (kingAttackTable[sq] & gs->piece_bb[2 * king + attacker]) |
+           (magicBishopAttacks(sq, occupancy) & (gs->piece_bb[2 * bishop + attacker] | queens)) |
+           (magicRookAttacks(sq, occupancy) & (gs->piece_bb[2 * rook + attacker] | queens));
+}
+
+// Returns whether the current player's king is in check
+int inCheck(game_state *gs) {
+    int color = gs->whose_turn;
+    return isSquareAttacked(gs, bbToSq(gs->piece_bb[2 * king + color]), 1 - color);
+}
+
+int position_is_legal(game_state *gs) {
+    U64 white_king = gs->piece_bb[2 * king + WHITE];
+    U64 black_king = gs->piece_bb[2 * king + BLACK];
+    if ((__builtin_popcountll(white_king) != 1) ||
+        (__builtin_popcountll(black_king) != 1)) {
+        return 0;
+    }
+    int color = gs->whose_turn;
+    return !isSquareAttacked(gs, bbToSq(gs->piece_bb[2 * king + 1 - color]),
+                             color);
+}
+
+/*
+
+Static exchange evaluation (SEE) estimates what a capture wins once every
+piece attacking the destination square has joined in: both sides keep
+recapturing with their least valuable attacker, and either side may stop
+when continuing would lose material. Removing each capturer from the
+occupancy uncovers any slider behind it (x-rays). Pins and checks are
+ignored, so this is only an estimate, but it's cheap and tells us which
+captures simply hang the capturing piece.
+
+*/
+int seeValue[6] = {100, 300, 300, 500, 900, 20000};
+
+// Material the side to move can expect to win (in centipawns) by making the
+// capture
+int see(game_state *gs, int move) {
+    square dest_sq = decodeDest(move);
+    U64 source_bb = (U64)1 << decodeSource(move);
+    int side = decodeTurn(move);
+    U64 occupancy = gs->all_bb ^ source_bb;
+    // Material won at each step of the exchange, from the capturer's side
+    int gain[32];
+    int d = 0;
+    if (decodeEnPassant(move)) {
+        gain[0] = seeValue[pawn];
+        occupancy ^= side ? ((U64)1 << dest_sq) << 8 : ((U64)1 << dest_sq) >> 8;
     } else {
-        pawn_attacks = wpAttacks(gs->piece_bb[2 * pawn + color]);
-    }
-    U64 knight_attacks = knightAttacks(gs->piece_bb[2 * knight + color]);
-    U64 bishop_attacks = bishopAttacks(gs->piece_bb[2 * bishop + color], empt);
-    U64 rook_attacks = rookAttacks(gs->piece_bb[2 * rook + color], empt);
-    U64 queen_attacks = queenAttacks(gs->piece_bb[2 * queen + color], empt);
-    U64 king_attacks = kingAttacks(gs->piece_bb[2 * king + color]);
-    return (pawn_attacks | knight_attacks | bishop_attacks | rook_attacks | queen_attacks | king_attacks) & king_bb;
-}
-
-// Saves memory to allow for move take-back
-void saveGamestate(game_state* gs, game_state *copy_address) {
-    copy_address->all_bb = gs->all_bb;
-    memcpy(copy_address->color_bb, gs->color_bb, sizeof(U64) * 2);
-    memcpy(copy_address->piece_bb, gs->piece_bb, sizeof(U64) * 12);
-    copy_address->whose_turn = gs->whose_turn;
-    copy_address->castling = gs->castling;
-    copy_address->en_passant = gs->en_passant;
-    copy_address->halfmove_counter = gs->halfmove_counter;
-    copy_address->moves = gs->moves;
-}
-
-// Restores game-state from memory 
-void undoPreviousMove(game_state *gs, game_state *copy_address) {
-    gs->all_bb = copy_address->all_bb;
-    memcpy(gs->color_bb, copy_address->color_bb, sizeof(U64) * 2);
-    memcpy(gs->piece_bb, copy_address->piece_bb, sizeof(U64) * 12);
-    gs->whose_turn = copy_address->whose_turn;
-    gs->castling = copy_address->castling;
-    gs->en_passant = copy_address->en_passant;
-    gs->halfmove_counter = copy_address->halfmove_counter;
-    gs->moves = copy_address->moves;
-}
-
-// Generates all LEGAL moves by pruning
-void generateLegalMoves(moves *move_list, game_state *gs) {
+        gain[0] = decodeCapture(move) ? seeValue[decodeCapturedPiece(move)] : 0;
+    }
+    // The piece standing on the square, which the next capture takes
+    piece on_square = decodePiece(move);
+    while (d < 31) {
+        side = 1 - side;
+        U64 attackers = attackersTo(gs, dest_sq, side, occupancy) & occupancy;
+        if (!attackers) {
+            break;
+        }
+        // Recapture with the least valuable attacker
+        piece piec = pawn;
+        U64 from_bb = 0;
+        for (; piec <= king; piec++) {
+            from_bb = attackers & gs->piece_bb[2 * piec + side];
+            if (from_bb) {
+                break;
+            }
+        }
+        d++;
+        gain[d] = seeValue[on_square] - gain[d - 1];
+        // If neither continuing nor stopping helps the side who just
+        // captured, the rest of the exchange can't change the result
+        if ((-gain[d - 1] < 0) && (gain[d] < 0)) {
+            break;
+        }
+        occupancy ^= from_bb & -from_bb;
+        on_square = piec;
+    }
+    // Each side picks the better of stopping or continuing, from the end back
+    for (; d > 0; d--) {
+        int best = (-gain[d - 1] > gain[d]) ? -gain[d - 1] : gain[d];
+        gain[d - 1] = -best;
+    }
+    return gain[0];
+}
+
+// Tests an en-passant capture directly: take both pawns off the board, put
+// ours on the destination, and see whether our king is attacked
+static int enPassantIsLegal(game_state *gs, square king_sq, U64 source_bb, U64 dest_bb) {
+    int color = gs->whose_turn;
+    int foe = 1 - color;
+    U64 captured_bb = color ? (dest_bb << 8) : (dest_bb >> 8);
+    U64 occupancy = (gs->all_bb ^ source_bb ^ captured_bb) | dest_bb;
+    return !(attackersTo(gs, king_sq, foe, occupancy) & ~captured_bb);
+}
+
+// Generates all LEGAL moves, using checks and pins
+/*
+
+The search doesn't always need every move: the quiescence search only wants
+captures, and a node which is cut off by its first capture never needs its
+quiet moves at all. So the generator can be restricted to:
+- GEN_CAPTURES: captures, en-passant, and promotions (which change the
+  material, so are searched with the captures)
+- GEN_QUIETS: everything else (including castling)
+- GEN_ALL: both
+and to the pieces standing on from_mask, which lets the search check that a
+move it remembers (from the hash table, or a killer) is legal here without
+generating every move. The moves go either in full to move_list, or in
+compact form to compact_list (whichever isn't NULL).
+
+*/
+static void generateMovesMasked(moves *move_list, compact_moves *compact_list, game_state *gs, int type,
+    U64 from_mask) {
     // Init 
-    move_list->count = 0;
-    // First, generate pseudo-legal moves
-    moves pseudo_legal;
-    generateAllMoves(&pseudo_legal, gs);
-    // Then save memory and try all out
-    game_state *save_file = MALLOC(1, game_state);
-    saveGamestate(gs, save_file);
-    for (int i = 0; i < pseudo_legal.count; i++) {
-        // Try out move
-        makeMove(pseudo_legal.moves[i], gs);
-        // If it works, add to movelist
-        if (!checkCheck(gs)) {
-            addMove(move_list, pseudo_legal.moves[i]);
+    if (move_list) {
+        move_list->count = 0;
+    } else {
+        compact_list->count = 0;
+    }
+    U64 piece_bb, source_bb, attacks_bb;
+    square source_sq;
+    int color = gs->whose_turn;
+    int foe = 1 - color;
+    U64 empt = ~gs->all_bb;
+    U64 friendlyFireMask = ~gs->color_bb[color];
+    U64 king_bb = gs->piece_bb[2 * king + color];
+    square king_sq = bbToSq(king_bb);
+    // Find checkers and pins
+    U64 checkers = attackersTo(gs, king_sq, foe, gs->all_bb);
+    U64 pinned = 0;
+    U64 enemyQueens = gs->piece_bb[2 * queen + foe];
+    U64 snipers = (magicRookAttacks(king_sq, 0) & (gs->piece_bb[2 * rook + foe] | enemyQueens)) |
+                  (magicBishopAttacks(king_sq, 0) & (gs->piece_bb[2 * bishop + foe] | enemyQueens));
+    while (snipers) {
+        square sniper_sq = bbToSq(snipers);
+        snipers &= snipers - 1;
+        U64 blockers = betweenTable[king_sq][sniper_sq] & gs->all_bb;
+        // Exactly one blocker, of our own color
+        if (blockers && !(blockers & (blockers - 1)) && (blockers & gs->color_bb[color])) {
+            pinned |= blockers;
+        }
+    }
+    // Which destinations each type of move may have (pawns also promote by
+    // pushing onto the last rank)
+    U64 promotionRank = color ? (U64)0xFF : (U64)0xFF << 56;
+    U64 targets = ~(U64)0;
+    U64 pawnTargets = ~(U64)0;
+    if (type == GEN_CAPTURES) {
+        targets = gs->color_bb[foe];
+        pawnTargets = gs->color_bb[foe] | promotionRank;
+    } else if (type == GEN_QUIETS) {
+        targets = empt;
+        pawnTargets = empt & ~promotionRank;
+    }
+    // King moves: never onto an attacked square (looking through the king)
+    if (king_bb & from_mask) {
+        attacks_bb = (kingAttacks(king_bb) & friendlyFireMask & targets);
+        U64 kingless = gs->all_bb ^ king_bb;
+        U64 safe_bb = 0;
+        while (attacks_bb) {
+            U64 dest_bb = attacks_bb & -attacks_bb;
+            attacks_bb &= attacks_bb - 1;
+            if (!attackersTo(gs, bbToSq(dest_bb), foe, kingless)) {
+                safe_bb |= dest_bb;
+            }
         }
-        // Undo before trying next
-        undoPreviousMove(gs, save_file);
+        if (!checkers && (type != GEN_CAPTURES)) {
+            safe_bb |= castlingAttacks(gs, king_bb);
+        }
+        if (move_list) {
+            addPieceMoves(move_list, gs, king, king_bb, safe_bb);
+        } else {
+            addCompactMoves(compact_list, king, king_bb, safe_bb);
+        }
+    }
+    // In double check, only the king may move
+    if (checkers & (checkers - 1)) {
+        return;
+    }
+    // Otherwise, every other move must resolve a single check (if any)
+    U64 checkMask = ~(U64)0;
+    if (checkers) {
+        checkMask = checkers | betweenTable[king_sq][bbToSq(checkers)];
+    }
+    for (piece piec = pawn; piec < king; piec++) {
+        piece_bb = gs->piece_bb[2 * piec + color] & from_mask;
+        while (piece_bb) {
+            source_bb = piece_bb & -piece_bb;
+            source_sq = bbToSq(source_bb);
+            piece_bb = piece_bb & (piece_bb - 1);
+            U64 enPassant_bb = 0;
+            switch (piec) {
+                case pawn:
+                    if (color) {
+                        attacks_bb = bpPushes(source_bb, empt) | (bpAttacks(source_bb) & gs->color_bb[foe]);
+                        enPassant_bb = bpAttacks(source_bb) & gs->en_passant;
+                    } else {
+                        attacks_bb = wpPushes(source_bb, empt) | (wpAttacks(source_bb) & gs->color_bb[foe]);
+                        enPassant_bb = wpAttacks(source_bb) & gs->en_passant;
+                    }
+                    break;
+                case knight:
+                    attacks_bb = knightAttackTable[source_sq];
+                    break;
+                case bishop:
+                    attacks_bb = magicBishopAttacks(source_sq, gs->all_bb);
+                    break;
+                case rook:
+                    attacks_bb = magicRookAttacks(source_sq, gs->all_bb);
+                    break;
+                default:
+                    attacks_bb = magicQueenAttacks(source_sq, gs->all_bb);
+                    break;
+            }
+            attacks_bb &= friendlyFireMask & checkMask & (piec == pawn ? pawnTargets : targets);
+            // Pinned pieces stay on the line through the king
+            if (pinned & source_bb) {
+                attacks_bb &= lineTable[king_sq][source_sq];
+            }
+            if (enPassant_bb && (type != GEN_QUIETS) && enPassantIsLegal(gs, king_sq, source_bb, enPassant_bb)) {
+                attacks_bb |= enPassant_bb;
+            }
+            if (move_list) {
+                addPieceMoves(move_list, gs, piec, source_bb, attacks_bb);
+            } else {
+                addCompactMoves(compact_list, piec, source_bb, attacks_bb);
+            }
+        }
+    }
+}
+
+void generateLegalMoves(moves *move_list, game_state *gs) {
+    PROFILE_BEGIN(start);
+    generateMovesMasked(move_list, NULL, gs, GEN_ALL, ~(U64)0);
+    PROFILE_END(start, PHASE_MOVEGEN);
+}
+
+// Legal captures, en-passant captures and promotions
+void generateCaptures(moves *move_list, game_state *gs) {
+    PROFILE_BEGIN(start);
+    generateMovesMasked(move_list, NULL, gs, GEN_CAPTURES, ~(U64)0);
+    PROFILE_END(start, PHASE_MOVEGEN);
+}
 
+// Every other legal move
+void generateQuiets(moves *move_list, game_state *gs) {
+    PROFILE_BEGIN(start);
+    generateMovesMasked(move_list, NULL, gs, GEN_QUIETS, ~(U64)0);
+    PROFILE_END(start, PHASE_MOVEGEN);
+}
+
+// Legal moves of one type (GEN_ALL, GEN_CAPTURES or GEN_QUIETS), compacted
+// for the search's move arena
+void generateCompact(compact_moves *move_list, game_state *gs, int type) {
+    PROFILE_BEGIN(start);
+    generateMovesMasked(NULL, move_list, gs, type, ~(U64)0);
+    PROFILE_END(start, PHASE_MOVEGEN);
+}
+
+// Whether a move (e.g. from the hash table) is legal in this position
+int isLegalMove(game_state *gs, int move) {
+    if (move == NULLMOVE) {
+        return 0;
+    }
+    moves move_list;
+    generateMovesMasked(&move_list, NULL, gs, GEN_ALL, (U64)1 << decodeSource(move));
+    for (int i = 0; i < move_list.count; i++) {
+        if (move_list.moves[i] == move) {
+            return 1;
+        }
     }
-    free(save_file);
+    return 0;
 }
 
 /*
@@ -919,29 +1500,119 @@ our move generation by means of well-known Perft testing positions and their
 accepted move counts.
 
 */
-// Counts legal moves at a given depth
+// Counts legal moves at a given depth. Nothing is allocated on the heap: each
+// ply keeps one move list and one undo_info on the stack. With printMove set,
+// prints the count under each root move ("divide"), for comparing against
+// another engine's counts to find a move generation bug
 U64 perft(int depth, game_state *gs, int printMove) {
-    moves move_list[256];
+    moves move_list;
+    undo_info undo;
     U64 count = 0;
+    U64 hash = 0;
 
     if (depth == 0)
     return 1ULL;
 
-    game_state *save_file = MALLOC(1, game_state);
+    // If the perft table is in use, we may already know this subtree's count
+    int use_table = perft_table_enabled() && (depth > 1) && !printMove;
+    if (use_table) {
+        hash = gs->hash;
+        if (get_perft_nodes(hash, depth, &count) == 0) {
+            return count;
+        }
+    }
 
-    generateLegalMoves(move_list, gs);
-    for (int i = 0; i < move_list->count; i++) {
-        saveGamestate(gs, save_file);
-        makeMove(move_list->moves[i], gs);
-        int current_count = perft(depth - 1, gs, 0);
+    generateLegalMoves(&move_list, gs);
+    // Bulk counting: the moves at the last ply are exactly the leaves, so
+    // there's no need to make them
+    if ((depth == 1) && !printMove) {
+        return move_list.count;
+    }
+    for (int i = 0; i < move_list.count; i++) {
+        makeMove(move_list.moves[i], gs, &undo);
+        U64 current_count = perft(depth - 1, gs, 0);
         if (printMove) {
-            square source_sq = decodeSource(move_list->moves[i]);
-            square dest_sq = decodeDest(move_list->moves[i]);
-            printf("\t%s -> %s\t\t:\t%i\n",boardStringMap[source_sq], boardStringMap[dest_sq], current_count);
+            char move_string[6];
+            moveToString(move_list.moves[i], move_string);
+            printf("%s: %llu\n", move_string, current_count);
         }
         count += current_count;
-        undoPreviousMove(gs, save_file);
+        unmakeMove(move_list.moves[i], gs, &undo);
+    }
+    if (use_table) {
+        update_perft_table(hash, depth, count);
+    }
+    return count;
+}
+
+/*
+
+Perft is easy to split across threads, since each root move's subtree can be
+counted independently. Each worker gets its own copy of the game_state, then
+repeatedly claims the next uncounted root move until none are left (so a
+thread which drew small subtrees just takes more of them). This only works
+because move generation has no shared mutable state: the lookup tables are
+read only once initialized, and everything else lives in the game_state.
+
+*/
+
+typedef struct perftWorker_t {
+    game_state gs;     // This thread's own copy of the position
+    moves *root_moves; // Shared, read only
+    U64 *counts;       // Count per root move, each written by one thread
+    int *next_move;    // Shared index of the next unclaimed root move
+    int depth;
+} perft_worker;
+
+static void *perftWorker(void *arg) {
+    perft_worker *worker = (perft_worker *)arg;
+    undo_info undo;
+    int i;
+    while ((i = __atomic_fetch_add(worker->next_move, 1, __ATOMIC_RELAXED)) < worker->root_moves->count) {
+        int move = worker->root_moves->moves[i];
+        makeMove(move, &worker->gs, &undo);
+        worker->counts[i] = perft(worker->depth - 1, &worker->gs, 0);
+        unmakeMove(move, &worker->gs, &undo);
+    }
+    return NULL;
+}
+
+// Counts legal moves at a given depth, splitting the root moves across
+// threads. With printMove set, prints the count under each root move
+U64 parallelPerft(int depth, game_state *gs, int threads, int printMove) {
+    moves root_moves;
+    U64 counts[256];
+    int next_move = 0;
+    U64 count = 0;
+    if (depth == 0) {
+        return 1ULL;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    generateLegalMoves(&root_moves, gs);
+    perft_worker *workers = MALLOC(threads, perft_worker);
+    pthread_t *handles = MALLOC(threads, pthread_t);
+    for (int t = 0; t < threads; t++) {
+        workers[t].gs = *gs;
+        workers[t].root_moves = &root_moves;
+        workers[t].counts = counts;
+        workers[t].next_move = &next_move;
+        workers[t].depth = depth;
+        pthread_create(&handles[t], NULL, perftWorker, &workers[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(handles[t], NULL);
+    }
+    for (int i = 0; i < root_moves.count; i++) {
+        if (printMove) {
+            char move_string[6];
+            moveToString(root_moves.moves[i], move_string);
+            printf("%s: %llu\n", move_string, counts[i]);
+        }
+        count += counts[i];
     }
-    free(save_file);
+    free(handles);
+    free(workers);
     return count;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -117,6 +117,14 @@ typedef struct moves_t {
     int moves[256]; // List of moves (each int encodes a move)
     int count;      // Number of moves in list
 } moves;
+// Move list in the compact 16-bit form (source, dest and promoted piece; the
+// rest comes from the mailbox when a move is expanded, see bitboards.c)
+typedef struct compactMoves_t {
+    unsigned short moves[256];
+    int count;
+} compact_moves;
+// Neurons in the first layer of the NNUE evaluation (see nnue.c)
+#define NNUE_HIDDEN 256
 // Game memory
 typedef struct gameState_t {
     U64 piece_bb[12];     // The pairs of boards for each piece
@@ -128,7 +136,26 @@ typedef struct gameState_t {
                           // en-passant
     int halfmove_counter; // Counter for 50 move rule
     int moves;            // Number of moves in game
+    U64 hash;             // Zobrist key of the position (see transposition.c)
+    U64 pawn_hash;        // Zobrist key of the pawns alone (see eval.c)
+    int psqt;             // Packed piece-square sum, white - black (eval.c)
+    int phase;            // Game phase (24 = all pieces on the board)
+    int board[64];        // Colored piece (2 * piece + color) on each square,
+                          // or NO_PIECE (mailbox, kept alongside bitboards)
+    short accumulator[2][NNUE_HIDDEN]; // First NNUE layer from each side's
+                                       // view (kept only while it's in use)
 } game_state;
+#define NO_PIECE (-1)
+// Everything needed to take back a move which the move itself doesn't encode
+typedef struct undoInfo_t {
+    int castling;         // Castling rights before the move
+    U64 en_passant;       // En-passant square before the move
+    int halfmove_counter; // 50 move rule counter before the move
+    U64 hash;             // Zobrist key before the move
+    U64 pawn_hash;        // Pawn key before the move
+    int psqt;             // Piece-square sum before the move
+    int phase;            // Game phase before the move
+} undo_info;
 
 /*
 ===========================================
@@ -153,10 +180,16 @@ extern void init_board(game_state *gs);
 #define PIECE_MAP "PpNnBbRrQqKk"
 // Parsing and printing
 extern int parse_fen(game_state *gs, char *fen);
+// Longest EPD line read from a file, and parsing the position at the start of
+// one (returning the rest of the line, or NULL if it isn't a position)
+#define EPD_LINE 512
+extern char *parse_epd(game_state *gs, char *line);
 extern void print_board(game_state *gs, last_move *lm, int useUnicode);
 extern void print_all_bitboards(game_state *gs);
 extern void print_extras(game_state *gs);
 extern void clear_bitboards(game_state *gs);
+// Fill in the mailbox from the bitboards (after setting up a position)
+extern void init_mailbox(game_state *gs);
 extern int bbToSq(U64 bb);
 
 // Generating attacks
@@ -170,6 +203,26 @@ extern U64 bishopAttacks(U64 bishop_bb, U64 all_bb);
 extern U64 rookAttacks(U64 rook_bb, U64 all_bb);
 extern U64 queenAttacks(U64 queen_bb, U64 all_bb);
 extern U64 checkCheck(game_state *gs);
+// Lookup tables for the non-sliding pieces, per square
+extern U64 knightAttackTable[64];
+extern U64 kingAttackTable[64];
+extern U64 pawnAttackTable[2][64];
+// Needs init_magic_bitboards() to have been called
+extern void init_attack_tables();
+extern int isSquareAttacked(game_state *gs, square sq, int attacker);
+// Squares strictly between two squares, and the full line through them
+extern U64 betweenTable[64][64];
+extern U64 lineTable[64][64];
+extern void init_line_tables();
+extern U64 attackersTo(game_state *gs, square sq, int attacker, U64 occupancy);
+// Whether the player to move is in check
+extern int inCheck(game_state *gs);
+// Whether a position can be searched: one king each, and the side which just
+// moved not left in check
+extern int position_is_legal(game_state *gs);
+// Static exchange evaluation: material a capture wins after all recaptures
+extern int seeValue[6];
+extern int see(game_state *gs, int move);
 
 // Encoding/decoding moves
 extern int encodeMove(U64 source_bb, U64 dest_bb, piece piec, piece promoteTo,
@@ -185,16 +238,30 @@ extern int decodeEnPassant(int move);
 extern int decodeCastle(int move);
 extern int decodeTurn(int move);
 extern piece decodeCapturedPiece(int move);
+extern int compactMove(int move);
+extern int expandMove(game_state *gs, int compact);
 
-// Saving game states
-extern void saveGamestate(game_state *gs, game_state *copy_address);
-extern void undoPreviousMove(game_state *gs, game_state *copy_address);
-extern void makeMove(int move, game_state *gs);
+// Making and taking back moves (undo may be NULL if the move won't be taken
+// back)
+extern void makeMove(int move, game_state *gs, undo_info *undo);
+extern void unmakeMove(int move, game_state *gs, undo_info *undo);
+// Passing the turn without moving, and taking it back
+extern void makeNullMove(game_state *gs, undo_info *undo);
+extern void unmakeNullMove(game_state *gs, undo_info *undo);
 
 // Finding moves
 extern void generateAllMoves(moves *moveList, game_state *gs);
 extern void generateLegalMoves(moves *move_list, game_state *gs);
+// Which legal moves to generate: captures (and promotions), quiets, or both
+#define GEN_ALL 0
+#define GEN_CAPTURES 1
+#define GEN_QUIETS 2
+extern void generateCaptures(moves *move_list, game_state *gs);
+extern void generateQuiets(moves *move_list, game_state *gs);
+extern void generateCompact(compact_moves *move_list, game_state *gs, int type);
+extern int isLegalMove(game_state *gs, int move);
 extern U64 perft(int depth, game_state *gs, int printMove);
+extern U64 parallelPerft(int depth, game_state *gs, int threads, int printMove);
 
 /*
 ===========================================
@@ -204,13 +271,15 @@ extern U64 perft(int depth, game_state *gs, int printMove);
 ===========================================
 */
 
-extern U64 RookMasks[64];
-extern U64 RookMagics[64];
-extern U64 BishopMasks[64];
-extern U64 BishopMagics[64];
-extern U64 *RookAttacks[64];
-extern U64 *BishopAttacks[64];
+// Magics found ahead of time (generated into magictables.c)
+extern const U64 precomputedRookMagics[64];
+extern const U64 precomputedBishopMagics[64];
+// Fills the lookup tables from the precomputed magics (fast)
 extern void init_magic_bitboards();
+// Fills the lookup tables from a fresh brute-force search (slow)
+extern void regen_magic_bitboards();
+// Prints the current magics as the source for magictables.c
+extern void print_magic_tables(FILE *out);
 extern U64 magicRookAttacks(square rook_sq, U64 all_bb);
 extern U64 magicBishopAttacks(square bishop_sq, U64 all_bb);
 extern U64 magicQueenAttacks(square queen_sq, U64 all_bb);
@@ -232,18 +301,38 @@ extern U64 magicQueenAttacks(square queen_sq, U64 all_bb);
 #define btxt "\x1b[30m"
 // Reset
 #define reset_txt "\x1b[0m"
-extern int parse_input(game_state *gs, last_move *lm, int mg_table[12][64],
-                       int eg_table[12][64]);
+extern int parse_input(game_state *gs, last_move *lm);
 extern int parse_fen(game_state *gs, char *fen);
 // For taking an index (square enum) and getting a string
 extern const char *boardStringMap[64];
 // For taking an index (piece enum) and getting a piece
 extern const char *pieceStringMap[6];
-// Helper to check whether the current game has ended (no legal moves)
+// Whether the current game has ended, and how (leaving the legal moves in ms)
+#define GAME_ONGOING 0
+#define GAME_CHECKMATE 1
+#define GAME_STALEMATE 2
+#define GAME_INSUFFICIENT 3
+extern int game_result(moves *ms, game_state *gs);
+// Helper to check whether the current game has ended, printing how if it has
 extern int checkGameover(moves *ms, game_state *gs);
 extern int get_time_ms();
+extern void sleep_ms(int ms);
+// A file mapped into memory, read only
+typedef struct mappedFile_t {
+    const void *data; // The file's contents (NULL if none is mapped)
+    size_t size;      // In bytes
+    void *handles[2]; // The file and mapping, on Windows
+} mapped_file;
+extern int map_file(const char *path, mapped_file *file);
+extern void unmap_file(mapped_file *file);
 extern void print_bitboard(U64 bitboard, int color);
 extern void printMoves(moves *moveList);
+// Long algebraic notation for a move (output needs room for 6 characters)
+extern void moveToString(int move, char *output);
+// Prints perft counts up to a depth, optionally per move at the last depth
+extern void printPerft(int depth, game_state *gs, int per_move_flag);
+extern void printParallelPerft(int depth, game_state *gs, int threads,
+                               int per_move_flag);
 extern int parse_move(char *input, game_state *gs, last_move *lm);
 
 /*
@@ -253,8 +342,7 @@ extern int parse_move(char *input, game_state *gs, last_move *lm);
 -------------------------------------------
 ===========================================
 */
-extern void uci_loop(game_state *gs, int mg_table[12][64],
-                     int eg_table[12][64]);
+extern void uci_loop(game_state *gs);
 
 /*
 ===========================================
@@ -263,10 +351,54 @@ extern void uci_loop(game_state *gs, int mg_table[12][64],
 -------------------------------------------
 ===========================================
 */
+// Packed scores: a middlegame and an endgame value in one int, which can be
+// added and subtracted as one (see eval.c)
+#define S(mg, eg) ((int)((unsigned int)(eg) << 16) + (mg))
+#define mgS(s) ((int)(short)(unsigned short)((unsigned int)(s) & 0xFFFF))
+#define egS(s) ((int)(short)(unsigned short)(((unsigned int)(s) + 0x8000) >> 16))
+// Piece-square tables (values include material), indexed by colored piece
+// and square
+extern int pst[12][64];
+// Game phase value of each colored piece
+extern int gamephaseInc[12];
 // Init piece-square tables
-extern void init_tables(int mg_table[12][64], int eg_table[12][64]);
+extern void init_tables();
+// Sets the piece-square sum and game phase (and the NNUE accumulators) for a
+// position from scratch (the mailbox must be up to date)
+extern void init_eval(game_state *gs);
 // Evaluates current position (in centipawns)
-extern int evaluate(game_state *gs, int mg_table[12][64], int eg_table[12][64]);
+extern int evaluate(game_state *gs);
+// Random number in the closed interval [0, max] (max <= RAND_MAX)
+extern long random_at_most(long max);
+// Pawn structure of a position (packed score, white - black), and each side's
+// passed pawns, through the pawn hash table
+extern int evaluate_pawns(game_state *gs, U64 passed[2]);
+
+/*
+===========================================
+-------------------------------------------
+                NNUE
+-------------------------------------------
+===========================================
+*/
+// Whether evaluate() uses the network (and makeMove keeps its accumulators)
+extern int nnue_enabled;
+// Maps a network file into memory, returning -1 if it can't be used. Loading
+// turns the network off until nnue_set_enabled turns it on
+extern int nnue_load(const char *path);
+// Uses the network if enabled is nonzero and one is loaded, returning whether
+// it is now in use
+extern int nnue_set_enabled(int enabled);
+extern int nnue_loaded();
+// Which vector instructions the network was compiled for
+extern const char *nnue_kernels();
+// Computes both accumulators from scratch (if a network is loaded)
+extern void nnue_refresh(game_state *gs);
+// Updates the accumulators for a move made or taken back by the given color
+extern void nnue_make_move(game_state *gs, int move, int color);
+extern void nnue_unmake_move(game_state *gs, int move, int color);
+// The network's score of the position, for the side to move (in centipawns)
+extern int nnue_evaluate(game_state *gs);
 
 /*
 ===========================================
@@ -275,17 +407,270 @@ extern int evaluate(game_state *gs, int mg_table[12][64], int eg_table[12][64]);
 -------------------------------------------
 ===========================================
 */
-// Finds best move for current player
-extern int findBestMove(game_state *gs, int mg_table[12][64],
-                        int eg_table[12][64], int depth, int *score);
-// Iteratively deepen w/ findBestMove
-extern int iterativelyDeepen(game_state *gs, int mg_table[12][64],
-                             int eg_table[12][64], int turn_time_ms);
+// Deepest ply the search keeps per-ply information for
+#define MAX_PLY 64
+// Scores: INF is beyond any score, and being checkmated n plies from the root
+// scores -(MATE - n), so any score past MATE_BOUND is a forced mate. All fit
+// in 16 bits, for the hash table
+#define INF 32000
+#define MATE 31000
+#define MATE_BOUND (MATE - MAX_PLY)
+// A tablebase win n plies from the root scores TB_WIN_SCORE - n, below any
+// mate (see syzygy.c), so any score past TB_WIN_BOUND is a tablebase win or a
+// mate, and depends on the distance from the root
+#define TB_WIN_SCORE (MATE_BOUND - MAX_PLY)
+#define TB_WIN_BOUND (TB_WIN_SCORE - MAX_PLY)
+// What a search may spend. No new iteration is started after the soft time
+// limit, and the search is stopped part way at the hard one (both in ms since
+// the search began, and no limit if negative). Depth and nodes are no limit if
+// 0
+typedef struct search_limits_t {
+    int soft_ms;
+    int hard_ms;
+    int depth;
+    U64 nodes;
+} search_limits;
+// The moves being searched at one ply (compact, see bitboards.c) and their
+// ordering scores, plus the losing captures put off until last (see the move
+// picker in search.c)
+typedef struct ply_moves_t {
+    compact_moves move_list;
+    int scores[256];
+    compact_moves bad_captures;
+} ply_moves;
+// The selective search's switches and margins (see search.c), which can differ
+// from one search to the next, e.g. to play two sets against each other
+typedef struct search_params_t {
+    int null_move;           // Null-move pruning on
+    int null_move_reduction; // ...and its reduction (plus depth / 6)
+    int lmr;                 // Late move reductions on
+    int futility;            // Futility pruning on
+    int futility_margin;     // ...and its margin per ply of depth
+} search_params;
+// The compile-time defaults
+extern const search_params default_search_params;
+// Statistics and move ordering information for one search (see search.c)
+typedef struct search_info_t {
+    // Interior and leaf (horizon) nodes visited
+    U64 nodes;
+    U64 qnodes;
+    // Hash table lookups, lookups finding the position, and lookups whose
+    // score could be used without searching
+    U64 tt_probes;
+    U64 tt_hits;
+    U64 tt_cutoffs;
+    // Beta cutoffs, and how many of them came from the first move searched
+    U64 beta_cutoffs;
+    U64 first_move_cutoffs;
+    // Null-window searches which had to be repeated with the full window, and
+    // root searches which fell outside their aspiration window
+    U64 pvs_researches;
+    U64 aspiration_researches;
+    // Selective search: null moves which cut, reduced moves which had to be
+    // searched again at full depth, and moves or nodes pruned by futility
+    U64 null_cutoffs;
+    U64 lmr_researches;
+    U64 futility_prunes;
+    // Nodes visited by the helper threads (see iterativelyDeepen)
+    U64 helper_nodes;
+    // Nodes whose score came from the endgame tablebases
+    U64 tb_hits;
+    // Set once the search has been told to stop, and the limits it checks
+    // while searching (only the main thread's are set)
+    int stopped;
+    search_limits *limits;
+    // The selective search's parameters (clear_search_info sets the defaults)
+    const search_params *params;
+    // Move ordering: two quiet moves per ply which caused cutoffs (killers),
+    // and a score per colored piece and destination for quiet moves which
+    // caused cutoffs anywhere in the tree (history)
+    int killers[MAX_PLY][2];
+    int history[12][64];
+    // Triangular principal variation table: pv[ply] is the best line found
+    // from ply onwards, pv_length[ply] long
+    int pv[MAX_PLY][MAX_PLY];
+    int pv_length[MAX_PLY];
+    // Whether the current node lies on the previous iteration's line, whose
+    // moves are then searched first
+    int follow_pv;
+    // Last completed iteration: its depth, score, best move and line
+    int depth;
+    int score;
+    int best_move;
+    int pv_line[MAX_PLY];
+    int pv_line_length;
+    // The search's move lists, one per ply, so that they needn't live on the
+    // stack of every node
+    ply_moves move_stack[MAX_PLY];
+    // Time since the search began, and time spent on the last iteration
+    int elapsed_ms;
+    int iteration_ms;
+} search_info;
+// Zeroes the statistics before a new search
+extern void clear_search_info(search_info *info);
+// Sets up the late move reduction table (before any search)
+extern void init_search();
+// Most threads one search can use, and setting how many it does (1 default)
+#define MAX_THREADS 64
+extern void set_search_threads(int threads);
+// Controlling a search running on another thread: prepare_search before
+// starting it (a pondering search has no time limit until ponderhit, and
+// doesn't end until then or told to stop), then stop_searching or ponderhit
+extern void prepare_search(int ponder);
+extern void stop_searching();
+extern void ponderhit();
+// Finds best move for current player, searching the full window
+extern int findBestMove(game_state *gs, int depth, int *score,
+                        search_info *info);
+// Plays out the captures quiescence expects from a position, leaving gs at the
+// quiet position its score comes from, and returns that score
+extern int resolve_quiet(game_state *gs, search_info *info);
+// Limits for a fixed time per move (exactly, or less the GUI's overhead), for
+// a depth and node count alone (no time limit), or from the time left on our
+// clock, our increment, and the moves left until the next time control (0 if
+// none)
+extern void fixed_time_limits(search_limits *limits, int turn_time_ms);
+extern void move_time_limits(search_limits *limits, int move_time_ms);
+extern void fixed_depth_limits(search_limits *limits, int depth, U64 nodes);
+extern void clock_time_limits(search_limits *limits, int time_left_ms,
+                              int increment_ms, int moves_to_go);
+// Iteratively deepen w/ findBestMove within limits. If report isn't NULL, it
+// is called after every completed iteration
+extern int iterativelyDeepen(game_state *gs, search_limits *limits,
+                             search_info *info,
+                             void (*report)(search_info *info));
+// Iteratively deepens within the depth and node limits (ignoring the time) on
+// the calling thread alone, with the given parameters (the defaults if NULL),
+// so that any number of positions can be searched at once (see analyze.c)
+extern int search_to_depth(game_state *gs, search_limits *limits,
+                           const search_params *params, search_info *info);
 // Debug search: simple pawn capture e4->f5
 extern void db_simple_pos();
 // Debug search: fork the king and rook via knight->d5
 extern void db_fork_pos();
 
+/*
+===========================================
+-------------------------------------------
+                BENCHMARK
+-------------------------------------------
+===========================================
+*/
+// Default position file and search depth for the benchmark
+#define BENCH_FILE "bench.epd"
+#define BENCH_DEPTH 4
+// Runs perft checks and fixed-depth searches over an EPD file, returning the
+// number of failed perft checks (or -1 if the file can't be read)
+extern int bench(char *epd_file, int depth);
+// Phase profiling (see bench.c): built with -DPROFILE_PHASES=1 (make
+// aldanphases), the time spent in each phase of the search is counted in CPU
+// cycles, wherever PROFILE_BEGIN and PROFILE_END surround it. Otherwise they
+// compile to nothing
+#ifndef PROFILE_PHASES
+#define PROFILE_PHASES 0
+#endif
+#define PHASE_MOVEGEN 0
+#define PHASE_MAKE_UNMAKE 1
+#define PHASE_EVAL 2
+#define PHASE_TT_PROBE 3
+#define PHASE_COUNT 4
+typedef struct phaseProfile_t {
+    U64 cycles[PHASE_COUNT];
+    U64 calls[PHASE_COUNT];
+} phase_profile;
+#if PROFILE_PHASES
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define profile_cycles() ((U64)__rdtsc())
+#else
+// Without a cycle counter, nanoseconds of the monotonic clock stand in
+extern U64 profile_cycles();
+#endif
+// Counted by every thread alike (without atomics, so the counts are only
+// exact for a single thread, as in the bench)
+extern phase_profile profile_counters;
+#define PROFILE_BEGIN(start) U64 start = profile_cycles()
+#define PROFILE_END(start, phase)                                              \
+    (profile_counters.cycles[phase] += profile_cycles() - (start),             \
+     profile_counters.calls[phase]++)
+#else
+#define PROFILE_BEGIN(start)
+#define PROFILE_END(start, phase)
+#endif
+
+/*
+===========================================
+-------------------------------------------
+                OPENING BOOK
+-------------------------------------------
+===========================================
+*/
+// Maps a Polyglot book, returning -1 if it can't be used
+extern int book_load(const char *path);
+// Whether a book is loaded
+extern int book_ready();
+// The Polyglot key of a position
+extern U64 polyglot_key(game_state *gs);
+// A book move for the position (picked by the moves' weights), or NULLMOVE
+extern int book_move(game_state *gs);
+
+/*
+===========================================
+-------------------------------------------
+            ENDGAME TABLEBASES
+-------------------------------------------
+===========================================
+*/
+// Most pieces any loaded table has (0 if none are)
+extern int syzygy_pieces;
+// Loads the Syzygy tables in a directory (or several, separated as in PATH),
+// returning syzygy_pieces, or -1 if they can't be (or the engine is built
+// without them)
+extern int syzygy_init(const char *path);
+// Sets *score from the WDL tables, ply plies from the root, returning 0 if
+// the position can't be probed
+extern int syzygy_probe_wdl(game_state *gs, int ply, int *score);
+// The tablebase move for the root (setting *score), or NULLMOVE if none
+extern int syzygy_probe_root(game_state *gs, int *score);
+
+/*
+===========================================
+-------------------------------------------
+                TUNING DATA
+-------------------------------------------
+===========================================
+*/
+// Turns a file of positions and game results into quiet-position records for
+// tuning the evaluation (see tune.c), using the given number of threads.
+// Returns the number of records written (or -1 if a file can't be opened)
+extern int export_tuning_data(char *input_file, char *output_file,
+                              int threads);
+
+/*
+===========================================
+-------------------------------------------
+                BATCH ANALYSIS
+-------------------------------------------
+===========================================
+*/
+// Searches every position of a file to depth (a default if 0), on the given
+// number of threads, printing each result as a line of JSON (see analyze.c).
+// Returns the number of positions searched (or -1 if the file can't be opened)
+extern int analyze_positions(char *input_file, int depth, int threads);
+
+/*
+===========================================
+-------------------------------------------
+                SELF-PLAY
+-------------------------------------------
+===========================================
+*/
+// Plays two search configurations against each other from the openings in a
+// file until an SPRT decides (see selfplay.c). Takes the arguments after
+// --selfplay: <openings> <base> <test> [options]. Returns the number of games
+// played (or -1 if the arguments or openings can't be used)
+extern int selfplay(int argc, char *argv[]);
+
 /*
 ===========================================
 -------------------------------------------
@@ -299,21 +684,46 @@ extern void init_zobrist_tables();
 extern void debug_tables();
 // Get the hash key for the start position
 extern U64 start_hash();
-// Get the hash key for the current position
+// Zobrist codes, for makeMove to keep gs->hash up to date: per colored piece
+// and square, per set of castling rights, per en-passant file, and for black
+// to move
+extern U64 pieceCodes[12][64];
+extern U64 castlingCodes[16];
+extern U64 enpassantCodes[8];
+extern U64 endTurnCode;
+// Compute the hash key for the current position from scratch, and the key of
+// its pawns alone (the pawn entries of pieceCodes)
 extern U64 current_pos_hash(game_state *gs);
-// Initialize the hash tables to 0s
+extern U64 current_pawn_hash(game_state *gs);
+// Hash table size used unless the UCI "Hash" option (or -ttsize) sets it
+#define DEFAULT_HASH_MB 64
+// (Re)allocate the hash table, in megabytes
+extern void resize_hash_table(int megabytes);
+// Initialize the hash tables to 0s (allocating if needed)
 extern void init_hash_table();
-// Update hash key
-extern U64 update_hash(int move, U64 currentHash);
-// Look into hash table, return 1 for no eval or less depth, otherwise return 0
-// and set *eval
+// Mark the start of a new search, so older entries get replaced first
+extern void age_hash_table();
+// Permill of the table used by the current search
+extern int hash_table_permill();
+// Look into hash table, returning whether the stored eval can be used (and
+// setting *eval), or else whether the position was found at all
+#define TT_USABLE 0
+#define TT_MISS 1
+#define TT_HIT 2
 extern int get_eval(U64 hash, int *eval, int relativeDepth, int alpha,
-                    int beta);
+                    int beta, int ply);
 // For "no best move"
 #define NULLMOVE 0
+// Best move stored for a position, or NULLMOVE if none is
+extern int get_hash_move(U64 hash);
 // Add eval to hash table
 void update_hash_table(U64 hash, int eval, int relativeDepth, int flag,
-                       int bestMove);
+                       int bestMove, int ply);
 // Debug updating hash
 extern void debug_all_updates();
+// Separate table for perft counts (sized in megabytes, 0 to disable)
+extern void init_perft_table(int megabytes);
+extern int perft_table_enabled();
+extern int get_perft_nodes(U64 hash, int depth, U64 *nodes);
+extern void update_perft_table(U64 hash, int depth, U64 nodes);
 #endif
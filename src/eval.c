@@ -230,81 +230,218 @@ int* eg_base_tables[6] = {
 int mg_value[6] = { 82, 337, 365, 477, 1025, 0};
 int eg_value[6] = { 94, 281, 297, 512,  936, 0};
 
+/*
+
+Evaluating a position from scratch means visiting every piece, but a move only
+changes a few of them. So instead, game_state keeps the sum of the piece-square
+values (material included) of every piece on the board, and makeMove adds and
+subtracts the values of the pieces it moves, captures, and promotes. Then a
+leaf's evaluation is a couple of lookups.
+
+To keep this to a single table lookup per change, both the middlegame and the
+endgame values for a colored piece on a square are packed into one int (the
+endgame value in the high 16 bits, see S()), and these are added and
+subtracted together. Black's values are negated, so the sum is simply white's
+score minus black's. The table is indexed like the bitboards (h1 = 0), so a
+square from a bitboard can be used directly.
+
+The game phase (how much material is left, from 24 at the start down to 0) is
+kept the same way.
+
+*/
+int pst[12][64];
+int gamephaseInc[12] = {0,0,1,1,1,1,2,2,4,4,0,0};
+
+// Pawn structure masks (see evaluate_pawns): each file (h to a, as squares
+// run), the files either side of it, and for a pawn of each color the squares
+// ahead of it on its own and the neighbouring files
+static U64 file_masks[8];
+static U64 adjacent_files[8];
+static U64 passed_masks[2][64];
+
+static void init_pawn_masks() {
+    for (int file = 0; file < 8; file++) {
+        file_masks[file] = 0x0101010101010101ULL << file;
+    }
+    for (int file = 0; file < 8; file++) {
+        adjacent_files[file] = (file > 0 ? file_masks[file - 1] : 0) |
+                               (file < 7 ? file_masks[file + 1] : 0);
+    }
+    for (square sq = h1; sq <= a8; sq++) {
+        U64 span = file_masks[sq % 8] | adjacent_files[sq % 8];
+        int rank = sq / 8;
+        // Ranks strictly above (for white) or below (for black)
+        U64 above = (rank < 7) ? ~0ULL << (8 * (rank + 1)) : 0;
+        U64 below = (rank > 0) ? ~0ULL >> (8 * (8 - rank)) : 0;
+        passed_masks[WHITE][sq] = span & above;
+        passed_masks[BLACK][sq] = span & below;
+    }
+}
+
 // Initialize tables
-void init_tables(int mg_table[12][64], int eg_table[12][64]) {
+void init_tables() {
     for (piece piec = pawn; piec <= king; piec++) {
-        for (int sq = 0; sq < 64; sq++) {
-            mg_table[2 * piec]  [sq] = mg_value[piec] + mg_base_tables[piec][sq];
-            eg_table[2 * piec]  [sq] = eg_value[piec] + eg_base_tables[piec][sq];
-            mg_table[2 * piec+1][sq] = mg_value[piec] + mg_base_tables[piec][sq^56];
-            eg_table[2 * piec+1][sq] = eg_value[piec] + eg_base_tables[piec][sq^56];
+        for (square sq = h1; sq <= a8; sq++) {
+            // The base tables are laid out as they are printed (a8 first),
+            // and from white's point of view
+            int logical_sq = 63 - sq;
+            pst[2 * piec][sq] =
+                S(mg_value[piec] + mg_base_tables[piec][logical_sq],
+                  eg_value[piec] + eg_base_tables[piec][logical_sq]);
+            pst[2 * piec + 1][sq] =
+                -S(mg_value[piec] + mg_base_tables[piec][logical_sq ^ 56],
+                   eg_value[piec] + eg_base_tables[piec][logical_sq ^ 56]);
+        }
+    }
+    init_pawn_masks();
+}
+
+// Computes the piece-square sum and game phase of a position from scratch
+// (makeMove keeps them up to date after this)
+void init_eval(game_state *gs) {
+    gs->psqt = 0;
+    gs->phase = 0;
+    for (int i = 0; i < 12; i++) {
+        U64 bb = gs->piece_bb[i];
+        while (bb) {
+            gs->psqt += pst[i][bbToSq(bb)];
+            gs->phase += gamephaseInc[i];
+            bb &= bb - 1;
+        }
+    }
+    nnue_refresh(gs);
+}
+
+/*
+
+Pawn structure: pawns are the slowest changing part of the position, and the
+same skeleton turns up again and again all over the search tree, so the
+structure is scored once per skeleton and kept in a small table of its own,
+keyed by the pawns alone (gs->pawn_hash). The terms:
+- doubled pawns: every pawn beyond the first on a file, which get in each
+  other's way
+- isolated pawns: no friendly pawn on either neighbouring file to defend them
+- defended pawns: those a friendly pawn protects
+- passed pawns: no enemy pawn ahead of them on their own or the neighbouring
+  files, worth more the further they've advanced (most of all in the endgame)
+
+Along with the score, the table keeps the passed pawns themselves, for any
+later terms (e.g. king distance) which depend on more than the pawns.
+
+Like the main hash table, the pawn table is shared by every search thread and
+checked by XORing the key with the rest of the entry, so that an entry torn
+by two threads writing it at once is never taken for a match.
+
+*/
+#define PAWN_TABLE_SIZE (1 << 14)
+#define DOUBLED_PAWN S(-10, -20)
+#define ISOLATED_PAWN S(-10, -15)
+#define DEFENDED_PAWN S(7, 5)
+// By rank, from the pawn's own side
+static const int passed_bonus[8] = {0,         S(5, 10),  S(5, 15),
+                                    S(10, 25), S(20, 45), S(35, 75),
+                                    S(60, 120), 0};
+
+typedef struct pawnEntry_t {
+    U64 check; // Key ^ passed[0] ^ passed[1] ^ score
+    U64 passed[2];
+    U64 score;
+} pawn_entry;
+
+static pawn_entry pawn_table[PAWN_TABLE_SIZE];
+
+// One side's pawn structure score
+static int pawnScore(U64 pawns, U64 enemy_pawns, int color, U64 *passed) {
+    int score = 0;
+    U64 defended = pawns & (color == WHITE ? wpAttacks(pawns) : bpAttacks(pawns));
+    score += num_bits(defended) * DEFENDED_PAWN;
+    for (int file = 0; file < 8; file++) {
+        int on_file = num_bits(pawns & file_masks[file]);
+        if (on_file > 1) {
+            score += (on_file - 1) * DOUBLED_PAWN;
         }
+        if (on_file && !(pawns & adjacent_files[file])) {
+            score += on_file * ISOLATED_PAWN;
+        }
+    }
+    *passed = 0;
+    U64 bb = pawns;
+    while (bb) {
+        square sq = bbToSq(bb);
+        if (!(passed_masks[color][sq] & enemy_pawns)) {
+            *passed |= (U64)1 << sq;
+            score += passed_bonus[color == WHITE ? sq / 8 : 7 - sq / 8];
+        }
+        bb &= bb - 1;
+    }
+    return score;
+}
+
+int evaluate_pawns(game_state *gs, U64 passed[2]) {
+    pawn_entry *entry = &pawn_table[gs->pawn_hash & (PAWN_TABLE_SIZE - 1)];
+    // Read each part once, as another thread may be changing them
+    U64 check = entry->check;
+    U64 passed_white = entry->passed[WHITE];
+    U64 passed_black = entry->passed[BLACK];
+    U64 score = entry->score;
+    if ((check ^ passed_white ^ passed_black ^ score) == gs->pawn_hash) {
+        passed[WHITE] = passed_white;
+        passed[BLACK] = passed_black;
+        return (int)score;
     }
+    U64 white_pawns = gs->piece_bb[2 * pawn + WHITE];
+    U64 black_pawns = gs->piece_bb[2 * pawn + BLACK];
+    int result = pawnScore(white_pawns, black_pawns, WHITE, &passed[WHITE]) -
+                 pawnScore(black_pawns, white_pawns, BLACK, &passed[BLACK]);
+    score = (U64)(unsigned int)result;
+    entry->passed[WHITE] = passed[WHITE];
+    entry->passed[BLACK] = passed[BLACK];
+    entry->score = score;
+    entry->check = gs->pawn_hash ^ passed[WHITE] ^ passed[BLACK] ^ score;
+    return result;
 }
 
 // Helper function to find which piece is on a given square.
 // If no piece, return -1. Sets color to the color of the piece,
 // also -1 if no piece.
 int find_piece(game_state *gs, int *color, square sq) {
-	U64 piece_exists = gs->all_bb & ((U64)1 << sq);
-    *color = -1;
-    int ret_piece = -1;
-	if (piece_exists) {
-        // Default white piece
-        *color = 0;
-        if (piece_exists & gs->color_bb[BLACK]) {
-            // Check if black
-            *color = 1;
-        }
-        // Find the piece
-        for (piece piec = pawn; piec <= king; piec++) {
-            if (piece_exists & gs->piece_bb[2 * piec + *color]) {
-                ret_piece = piec;
-                break;
-            }
-        }
+    int colored_piece = gs->board[sq];
+    if (colored_piece == NO_PIECE) {
+        *color = -1;
+        return -1;
     }
-    return ret_piece;
+    *color = colored_piece % 2;
+    return colored_piece / 2;
 }
 
-int gamephaseInc[12] = {0,0,1,1,1,1,2,2,4,4,0,0};
-
 // The main function: evaluating a board. Includes many helper functions to take
 // into account different evaluation methods
-int evaluate(game_state *gs, int mg_table[12][64], int eg_table[12][64]) {
-	int color = gs->whose_turn;
-	int foe = 1 - color;
-	int mg[2];
-    int eg[2];
-	// Scaling factor (middle to endgame)
-    int gamePhase = 0;
-	// Evals per color
-    mg[WHITE] = 0;
-    mg[BLACK] = 0;
-    eg[WHITE] = 0;
-    eg[BLACK] = 0;
-	// The piece-square tables are ordered logically to represent
-	// on-screen a chessboard, but the enum "square" is ordered
-	// logically to allow for bit shifting "intuitively", meaning
-	// a8 = 0 for the tables, but h1 = 0 for the bitboards
-    for (square sq = h1; sq <= a8; sq++) {
-        int logical_sq = 63 - sq;
-        int color = -1;
-        int piec = find_piece(gs, &color, sq);
-        if (piec != -1) {
-            mg[color] += mg_table[2 * piec + color][logical_sq];
-            eg[color] += eg_table[2 * piec + color][logical_sq];
-            gamePhase += gamephaseInc[piec];
-        }
-    }
-
-    // Scoring: current player - foe (for negamax), scaled by the game phase
-    int mgScore = mg[color] - mg[foe];
-    int egScore = eg[color] - eg[foe];
-    int mgPhase = gamePhase;
+// The hand-written evaluation, for the side to move
+static int evaluateTerms(game_state *gs) {
+    // Scoring: white - black, scaled by the game phase
+    U64 passed[2];
+    int packed = gs->psqt + evaluate_pawns(gs, passed);
+    int mgScore = mgS(packed);
+    int egScore = egS(packed);
+    int mgPhase = gs->phase;
     if (mgPhase > 24) mgPhase = 24; /* in case of early promotion */
     int egPhase = 24 - mgPhase;
-    // Get random noise (between -2 and 2)
-	int noise = random_at_most(4) - 2;
-    return (((mgScore * mgPhase + egScore * egPhase) / 24) + noise);
-}
\ No newline at end of file
+    int score = (mgScore * mgPhase + egScore * egPhase) / 24;
+    // Current player - foe (for negamax)
+    if (gs->whose_turn == BLACK) {
+        score = -score;
+    }
+    return score;
+}
+
+int evaluate(game_state *gs) {
+    PROFILE_BEGIN(start);
+    // The network (see nnue.c) if one is in use, otherwise the terms above
+    int score = nnue_enabled ? nnue_evaluate(gs) : evaluateTerms(gs);
+    // Noise (between -2 and 2), taken from the position's key so that it is
+    // the same every time the position is seen, and needs no shared random
+    // number generator between search threads
+    int noise = (int)((gs->hash >> 32) % 5) - 2;
+    PROFILE_END(start, PHASE_EVAL);
+    return score + noise;
+}
@@ -9,6 +9,10 @@
 #include <unistd.h>
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 /*
@@ -131,7 +135,8 @@ char *castle_map = "KQkq";
 static int parse_extras(game_state *gs, char *inp, long unsigned int idx) {
     // First, copy the fen to a bigger buffer to avoid faults
     char fen[400];
-    strcpy(fen, inp);
+    strncpy(fen, inp, sizeof(fen) - 1);
+    fen[sizeof(fen) - 1] = '\0';
     // Next, our idx should move past the space
     idx++;
     // Find whose turn it is
@@ -179,14 +184,14 @@ static int parse_extras(game_state *gs, char *inp, long unsigned int idx) {
     } else if (fen[idx] == ' ') {
         return 1;
     } else {
-        if (!isdigit(fen[idx])) {
+        // Square in algebraic notation, e.g. e3
+        int file = fen[idx] - 'a';
+        int rank = fen[idx + 1] - '1';
+        if ((file < 0) || (7 < file) || (rank < 0) || (7 < rank)) {
             return 1;
         }
-        // Extract the number
-        while (isdigit(fen[idx])) {
-            gs->en_passant = (gs->en_passant * 10) + (fen[idx] - '0');
-            idx++;
-        }
+        gs->en_passant = (U64)1 << (8 * rank + (7 - file));
+        idx += 2;
         if (fen[idx] != ' ') {
             return 1;
         } else {
@@ -216,8 +221,12 @@ static int parse_extras(game_state *gs, char *inp, long unsigned int idx) {
         gs->moves = (gs->moves * 10) + (fen[idx] - '0');
         idx++;
     }
-    if (idx != strlen(fen) - 1) {
-        return 1;
+    // Anything left over should just be whitespace (a newline, for instance)
+    while (fen[idx]) {
+        if (!isspace(fen[idx])) {
+            return 1;
+        }
+        idx++;
     }
     return 0;
 }
@@ -260,16 +269,59 @@ int parse_fen(game_state *gs, char *fen) {
             // if space, reached extras section. certain letters are reused, so
             // we need a new conditional branch
         } else if (ch == ' ') {
-            return parse_extras(gs, fen, idx);
+            int err = parse_extras(gs, fen, idx);
+            init_mailbox(gs);
+            gs->hash = current_pos_hash(gs);
+            gs->pawn_hash = current_pawn_hash(gs);
+            init_eval(gs);
+            return err;
             // for any other character return 1 for error: bad FEN string
         } else {
             return 1;
         }
         pos >>= 1;
     }
+    init_mailbox(gs);
+    gs->hash = current_pos_hash(gs);
+    gs->pawn_hash = current_pawn_hash(gs);
+    init_eval(gs);
     return 0;
 }
 
+// Parses the position at the start of an EPD (or FEN) line: the first four FEN
+// fields, and the move counters if there are any (parse_fen wants all six).
+// Returns what follows the position (its operations, a game result...), or
+// NULL if it couldn't be parsed
+char *parse_epd(game_state *gs, char *line) {
+    char fen[EPD_LINE + 8];
+    char *end = line;
+    for (int field = 0; field < 4; field++) {
+        end += strspn(end, " \t");
+        if (!*end) {
+            return NULL;
+        }
+        end += strcspn(end, " \t\r\n");
+    }
+    char *rest = end;
+    int counters = 0;
+    for (int field = 0; field < 2; field++) {
+        char *start = rest + strspn(rest, " \t");
+        int digits = strspn(start, "0123456789");
+        if (!digits || !strchr(" \t\r\n", start[digits])) {
+            break;
+        }
+        rest = start + digits;
+        counters++;
+    }
+    if (counters == 2) {
+        snprintf(fen, sizeof(fen), "%.*s", (int)(rest - line), line);
+    } else {
+        snprintf(fen, sizeof(fen), "%.*s 0 1", (int)(end - line), line);
+        rest = end;
+    }
+    return parse_fen(gs, fen) ? NULL : rest;
+}
+
 /*
 
 Finally, we introduce a "GUI" (sort of). Unicode has kindly given us every
@@ -469,6 +521,17 @@ void printMove(int move) {
            capture, doubled, enPassant, castle);
 }
 
+// Writes a move in long algebraic notation (e.g. e2e4, or e7e8q for a
+// promotion) into output, which needs room for 6 characters
+void moveToString(int move, char *output) {
+    piece promoteTo = decodePromote(move);
+    strcpy(output, boardStringMap[decodeSource(move)]);
+    strcpy(output + 2, boardStringMap[decodeDest(move)]);
+    if (promoteTo != pawn) {
+        strcpy(output + 4, pieceStringMap[promoteTo]);
+    }
+}
+
 // Debugging function to print all moves in a movelist
 void printMoves(moves *moveList) {
     printf(
@@ -521,13 +584,11 @@ int parse_move(char *input, game_state *gs, last_move *lm) {
     // Whether we promote (pawn = default, means no promotion)
     piece promoteTo = pawn;
     promoteTo = charToPiece(input[4]);
-    // Find which piece we are moving
+    // Find which piece we are moving (treating an empty square as a pawn, as
+    // such a move is rejected anyway)
     piece piec = pawn;
-    for (int pc_idx = 2; pc_idx < 12; pc_idx++) {
-        if (source_bb & gs->piece_bb[pc_idx]) {
-            piec = pc_idx / 2;
-            break;
-        }
+    if (gs->board[bbToSq(source_bb)] != NO_PIECE) {
+        piec = gs->board[bbToSq(source_bb)] / 2;
     }
     // Find other extras: whether we are capturing, double moving a pawn,
     // en-passant capturing, or castling
@@ -541,12 +602,7 @@ int parse_move(char *input, game_state *gs, last_move *lm) {
     // If we do capture, encode which piece we capture (useful for hashing)
     piece capturedPiec = pawn;
     if (captureFlag) {
-        for (piece p = pawn; p <= king; p++) {
-            if (dest_bb & gs->piece_bb[2 * p + (1 - color)]) {
-                capturedPiec = p;
-                break;
-            }
-        }
+        capturedPiec = gs->board[bbToSq(dest_bb)] / 2;
     }
     // Finally, encode the move
     int move =
@@ -556,17 +612,15 @@ int parse_move(char *input, game_state *gs, last_move *lm) {
     moves *move_list = MALLOC(1, moves);
     generateAllMoves(move_list, gs);
     if (matchMove(move, move_list)) {
-        // Save status before making move
-        game_state *save_file = MALLOC(1, game_state);
-        saveGamestate(gs, save_file);
         // Make move ...
-        makeMove(move, gs);
+        undo_info undo;
+        makeMove(move, gs, &undo);
         // ... then check if this would put the king in check, and undo move if
         // needed
         if (checkCheck(gs)) {
             printf("This move would have the king in check\n");
-            undoPreviousMove(gs, save_file);
-            free(save_file);
+            unmakeMove(move, gs, &undo);
+            free(move_list);
             return -1;
         }
     } else {
@@ -586,18 +640,103 @@ int parse_move(char *input, game_state *gs, last_move *lm) {
     return 2;
 }
 
-// Helper for perft: get time in milliseconds
+// Helper for perft and the search's clock: get time in milliseconds. Only
+// differences mean anything, so the clock used is one which never jumps (as
+// the time of day can), counted from the first call so the milliseconds stay
+// small and non-negative (the raw clock counts from boot, and would overflow
+// an int after 24.8 days)
+static long long clock_base_ms = -1;
 int get_time_ms() {
-#ifdef WIN64
-    return GetTickCount();
+#ifdef _WIN32
+    long long now = GetTickCount64();
 #else
     struct timespec time;
-    clock_gettime(CLOCK_REALTIME, &time);
-    return time.tv_sec * 1000 + time.tv_nsec / 1000000;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    long long now = (long long)time.tv_sec * 1000 + time.tv_nsec / 1000000;
 #endif
+    long long base = __atomic_load_n(&clock_base_ms, __ATOMIC_RELAXED);
+    if (base < 0) {
+        // Whichever thread gets here first sets the base for everyone
+        long long unset = -1;
+        __atomic_compare_exchange_n(&clock_base_ms, &unset, now, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        base = __atomic_load_n(&clock_base_ms, __ATOMIC_RELAXED);
+    }
+    return (int)(now - base);
 }
 
-// Helper to print perft counts
+// Waits for (at least) the given number of milliseconds
+void sleep_ms(int ms) { usleep(ms * 1000); }
+
+// Maps a whole file into memory (read only), for the NNUE network and the
+// opening book, which are used in place rather than read in. Returns -1 if
+// the file can't be mapped (or is empty)
+int map_file(const char *path, mapped_file *file) {
+    file->data = NULL;
+    file->size = 0;
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(handle, &size) && (size.QuadPart > 0)) {
+        mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    if (mapping) {
+        file->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!file->data) {
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(handle);
+        return -1;
+    }
+    file->size = (size_t)size.QuadPart;
+    file->handles[0] = handle;
+    file->handles[1] = mapping;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || (st.st_size == 0)) {
+        close(fd);
+        return -1;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid once the file is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    file->data = data;
+    file->size = st.st_size;
+#endif
+    return 0;
+}
+
+// Unmaps a file mapped by map_file (doing nothing if none is)
+void unmap_file(mapped_file *file) {
+    if (!file->data) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(file->data);
+    CloseHandle(file->handles[1]);
+    CloseHandle(file->handles[0]);
+#else
+    munmap((void *)file->data, file->size);
+#endif
+    file->data = NULL;
+    file->size = 0;
+}
+
+// Helper to print perft counts, with the speed in nodes (leaves) per second
 void printPerft(int depth, game_state *gs, int per_move_flag) {
     U64 depth_count;
     depth += 1;
@@ -608,9 +747,25 @@ void printPerft(int depth, game_state *gs, int per_move_flag) {
         }
         depth_count = perft(i, gs, (i == depth - 1 ? per_move_flag : 0));
         int end_ms = get_time_ms();
-        printf("Depth %i\t:\t%llu moves\t:\t%i ms\n", i, depth_count,
-               end_ms - start_ms);
+        int elapsed_ms = end_ms - start_ms;
+        printf("Depth %i\t:\t%llu moves\t:\t%i ms\t:\t%llu nps\n", i,
+               depth_count, elapsed_ms,
+               depth_count * 1000 / (elapsed_ms > 0 ? elapsed_ms : 1));
+    }
+}
+
+// Helper to print a threaded perft count at a single depth
+void printParallelPerft(int depth, game_state *gs, int threads,
+                        int per_move_flag) {
+    if (per_move_flag) {
+        printf("\nMoves for depth %i:\n", depth);
     }
+    int start_ms = get_time_ms();
+    U64 depth_count = parallelPerft(depth, gs, threads, per_move_flag);
+    int elapsed_ms = get_time_ms() - start_ms;
+    printf("Depth %i\t:\t%llu moves\t:\t%i ms\t:\t%llu nps\t:\t%i threads\n",
+           depth, depth_count, elapsed_ms,
+           depth_count * 1000 / (elapsed_ms > 0 ? elapsed_ms : 1), threads);
 }
 
 // Helper to parse depth (should be string of digits)
@@ -632,34 +787,43 @@ int parseDepth(char *input) {
 }
 
 // Helper to check whether the current game has ended (no legal moves)
-int checkGameover(moves *ms, game_state *gs) {
-    // If there is insufficient material, the game is over
-    // For now, only lone kings are insufficient material
+int game_result(moves *ms, game_state *gs) {
+    // If there is insufficient material, the game is over: lone kings, or
+    // kings and a single bishop or knight
+    int minors = 0;
     int material_flag = 1;
     for (piece piec = pawn; piec < king; piec++) {
-        if (gs->color_bb[2 * piec] || gs->color_bb[2 * piec + 1]) {
+        U64 pieces_bb = gs->piece_bb[2 * piec] | gs->piece_bb[2 * piec + 1];
+        if ((piec == knight) || (piec == bishop)) {
+            minors += __builtin_popcountll(pieces_bb);
+        } else if (pieces_bb) {
             material_flag = 0;
-            break;
         }
     }
-    if (material_flag) {
-        printf("The game is a draw by insufficient material.\n\n");
-        return 1;
+    if (material_flag && (minors <= 1)) {
+        return GAME_INSUFFICIENT;
     }
     generateLegalMoves(ms, gs);
     // If there are no legal moves, the game is over
     if (ms->count == 0) {
-        printf("Game over! ");
-        // Flip turn to make the check function look at the next player's king
-        gs->whose_turn = 1 - gs->whose_turn;
-        if (checkCheck(gs)) {
-            printf("%s has been checkmated.\n\n",
-                   1 - gs->whose_turn ? "Black" : "White");
-        } else {
-            printf("The game is a stalemate.\n\n");
-        }
+        return inCheck(gs) ? GAME_CHECKMATE : GAME_STALEMATE;
+    }
+    return GAME_ONGOING;
+}
+
+int checkGameover(moves *ms, game_state *gs) {
+    switch (game_result(ms, gs)) {
+    case GAME_INSUFFICIENT:
+        printf("The game is a draw by insufficient material.\n\n");
         return 1;
-    } else {
+    case GAME_CHECKMATE:
+        printf("Game over! %s has been checkmated.\n\n",
+               gs->whose_turn ? "Black" : "White");
+        return 1;
+    case GAME_STALEMATE:
+        printf("Game over! The game is a stalemate.\n\n");
+        return 1;
+    default:
         return 0;
     }
 }
@@ -671,8 +835,7 @@ We return 0 for failure, -1 for no new board, and 1 for a new board.
 
 // max buffer size
 #define INPUT_BUFFER 10000
-int parse_input(game_state *gs, last_move *lm, int mg_table[12][64],
-                int eg_table[12][64]) {
+int parse_input(game_state *gs, last_move *lm) {
     // reset buffers
     setvbuf(stdin, NULL, _IOFBF, BUFSIZ);
     setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
@@ -716,8 +879,19 @@ int parse_input(game_state *gs, last_move *lm, int mg_table[12][64],
             "-legalmoves\t:\tprint all legal moves in the current position\n");
         printf("-perft [depth]\t:\tprint the number of legal moves at a given "
                "depth\n");
+        printf("-perftmt [depth] [threads]\n\t\t:\tlike -perft at only the "
+               "given depth, splitting the\n\t\t\troot moves across threads "
+               "(-perfmmt to also divide)\n");
+        printf("-perfthash [MB]\t:\tgives perft its own hash table of this size "
+               "(0 to\n\t\t\tturn it off), for deep perft runs\n");
+        printf("-perfm [depth]\t:\tlike -perft, but also prints the count "
+               "under each\n\t\t\tmove at the last depth (\"divide\")\n");
         printf("-eval\t\t:\tgives evaluation score of current position\n");
         printf("-test\t\t:\thave the computer play itself\n");
+        printf("-ttsize [MB]\t:\tsets the size of the search's hash table "
+               "(clearing it)\n");
+        printf("-nnue [file]\t:\tevaluates with the NNUE network in a file, "
+               "or without one\n\t\t\tif no file is given\n");
         printf("-hash\t\t:\tcheck for hash collisions (currently just checks "
                "bitstring keys)\n");
         printf("-dbhash\t\t:\tchecks whether updating the hash is working as "
@@ -817,6 +991,31 @@ int parse_input(game_state *gs, last_move *lm, int mg_table[12][64],
         free(move_list);
         return -1;
     }
+    // Threaded perft, with or without per-move counts (before -perft and
+    // -perfm, which share their prefixes)
+    else if (!strncmp(input, "-perftmt", 8) || !strncmp(input, "-perfmmt", 8)) {
+        int depth, threads;
+        if (sscanf(input + 8, "%d %d", &depth, &threads) != 2 || depth < 0 ||
+            threads < 1) {
+            printf("The depth and thread count were ill-formatted, please use "
+                   "two integers, for example \'-perftmt 6 4\'");
+        } else {
+            printParallelPerft(depth, gs, threads, input[5] == 'm');
+        }
+        return -1;
+    }
+    // Size the perft hash table (before -perft, which shares its prefix)
+    else if (!strncmp(input, "-perfthash", 10)) {
+        int megabytes = parseDepth(input + 11);
+        if (megabytes == -1) {
+            printf("The size was ill-formatted, please use an integer number "
+                   "of megabytes, for example \'-perfthash 64\'");
+        } else {
+            init_perft_table(megabytes);
+            printf("Perft hash table set to %i MB\n", megabytes);
+        }
+        return -1;
+    }
     // Show perft counts for given depth
     else if (!strncmp(input, "-perft", 6)) {
         int depth = parseDepth(input + 7);
@@ -840,13 +1039,43 @@ int parse_input(game_state *gs, last_move *lm, int mg_table[12][64],
         return -1;
         // Show evaluation of current board (no search)
     } else if (!strncmp(input, "-eval", 5)) {
-        printf("Board evaluation = %i\n", evaluate(gs, mg_table, eg_table));
+        printf("Board evaluation = %i\n", evaluate(gs));
         return -1;
     }
     // Make computer play itself
     else if (!strncmp(input, "-test", 5)) {
         return 3;
     }
+    // Resize the search's hash table
+    else if (!strncmp(input, "-ttsize", 7)) {
+        int megabytes = parseDepth(input + 8);
+        if (megabytes <= 0) {
+            printf("The size was ill-formatted, please use a positive integer "
+                   "number of megabytes, for example \'-ttsize 256\'");
+        } else {
+            resize_hash_table(megabytes);
+            printf("Hash table set to %i MB\n", megabytes);
+        }
+        return -1;
+    }
+    // Switch the evaluation to a network (or back to the hand-written one)
+    else if (!strncmp(input, "-nnue", 5)) {
+        char *path = input + 5;
+        path += strspn(path, " ");
+        path[strcspn(path, "\r\n")] = '\0';
+        if (!*path) {
+            nnue_set_enabled(0);
+            printf("Using the hand-written evaluation\n");
+        } else if (nnue_load(path)) {
+            printf("Could not load a network from %s\n", path);
+        } else {
+            nnue_set_enabled(1);
+            nnue_refresh(gs);
+            printf("Using the network in %s (%s kernels)\n", path,
+                   nnue_kernels());
+        }
+        return -1;
+    }
     // Check for hash collisions
     else if (!strncmp(input, "-hash", 5)) {
         debug_tables();
@@ -874,4 +1103,4 @@ int parse_input(game_state *gs, last_move *lm, int mg_table[12][64],
         return parse_move(input, gs, lm);
     }
     return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
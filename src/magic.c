@@ -49,16 +49,37 @@ which would block the sliding piece) "masked" so that we only look at those alon
 sliding directions, and a bit of "magic" to make hash collisions useful - that is, 
 when keys collide, they only collide if the resulting legal moves would be the same.
 
-*/
+CPUs with BMI2 can do better: PEXT gathers the bits of the occupancy under the
+mask into a dense index by itself, so there is no multiply and no magic at all
+(the tables are the same size, as each square has exactly 2^bits occupancies).
+It is used whenever the compiler targets BMI2 (e.g. make native), unless built
+with -DUSE_PEXT=0, as AMD's chips before Zen 3 run PEXT very slowly. The magics
+are still kept, for every other build.
 
-// Masks and magics
+*/
+#ifndef USE_PEXT
+#ifdef __BMI2__
+#define USE_PEXT 1
+#else
+#define USE_PEXT 0
+#endif
+#endif
+#if USE_PEXT
+#include <immintrin.h>
+#endif
+
+// Masks and magics. The attack tables are "flattened": rather than giving
+// every square room for 4096 entries, each square only gets 2^bits entries,
+// starting at its offset into one shared array
 U64 rookMasks[64];
 U64 rookMagics[64];
-U64 rookAttacksTable[64][4096];
+U64 rookAttacksTable[102400];
+U64 *rookAttacksPtr[64];
 
 U64 bishopMasks[64];
 U64 bishopMagics[64];
-U64 bishopAttacksTable[64][4096];
+U64 bishopAttacksTable[5248];
+U64 *bishopAttacksPtr[64];
 
 U64 edgeMask = 0b0000000001111110011111100111111001111110011111100111111000000000;
 U64 rank1 	 = 0b0000000000000000000000000000000000000000000000000000000011111111;
@@ -144,13 +165,22 @@ static int get_magic_key(U64 occupancy, U64 magic, int numBits) {
   return (int)((occupancy * magic) >> (64 - numBits));
 }
 
+// Index of an occupancy into a square's attack table, by PEXT or by its magic
+static int attack_index(U64 occupancy, U64 mask, U64 magic, int numBits) {
+#if USE_PEXT
+  (void)magic;
+  (void)numBits;
+  return (int)_pext_u64(occupancy, mask);
+#else
+  return get_magic_key(occupancy & mask, magic, numBits);
+#endif
+}
+
 static U64 find_magic(square sq, int numBits, int doRooks, U64 masks[64]) {
 	U64 mask = masks[sq];
-	U64 b[4096], a[4096], magic;
+	U64 b[4096], a[4096], used[4096], magic;
 	int i, j, k, n, fail;
 
-	U64 *used = doRooks? rookAttacksTable[sq] : bishopAttacksTable[sq];
-
 	// Find number of flipped bits
 	n = __builtin_popcountll(mask);
 
@@ -170,10 +200,28 @@ static U64 find_magic(square sq, int numBits, int doRooks, U64 masks[64]) {
 		}
 		if(!fail) return magic;
 	}
-	printf("***Failed***\n");
+	fprintf(stderr, "***Failed***\n");
 	return 0ULL;
 }
 
+/*
+
+Once a magic is known, filling its part of the lookup table is a single pass
+over every occupancy of the mask, which is far cheaper than the search above.
+This is what lets us skip the search at startup: the magics themselves are
+found once, ahead of time, and kept in magictables.c
+
+*/
+
+static void fill_attacks(square sq, int numBits, int doRooks, U64 mask, U64 magic, U64 *table) {
+	int n = __builtin_popcountll(mask);
+	for (int i = 0; i < (1 << n); i++) {
+		U64 occupancy = index_to_uint64(i, n, mask);
+		table[attack_index(occupancy, mask, magic, numBits)] =
+			doRooks? rookAttacks(1ULL << sq, ~occupancy) : bishopAttacks(1ULL << sq, ~occupancy);
+	}
+}
+
 static const int RBits[64] = {
   12, 11, 11, 11, 11, 11, 11, 12,
   11, 10, 10, 10, 10, 10, 10, 11,
@@ -196,25 +244,74 @@ static const int BBits[64] = {
   6, 5, 5, 5, 5, 5, 5, 6
 };
 
-void init_magic_bitboards() {
+// Sets up the masks and the offset of each square into the flattened tables
+static void init_magic_layout() {
 	init_rook_masks(rookMasks);
 	init_bishop_masks(bishopMasks);
+	U64 *rookNext = rookAttacksTable;
+	U64 *bishopNext = bishopAttacksTable;
+	for (square sq = h1; sq <= a8; sq++) {
+		rookAttacksPtr[sq] = rookNext;
+		rookNext += 1 << RBits[sq];
+		bishopAttacksPtr[sq] = bishopNext;
+		bishopNext += 1 << BBits[sq];
+	}
+}
+
+// Fills every square's attacks from the magics currently in rookMagics and
+// bishopMagics
+static void fill_all_attacks() {
+	for (square sq = h1; sq <= a8; sq++) {
+		fill_attacks(sq, RBits[sq], 1, rookMasks[sq], rookMagics[sq], rookAttacksPtr[sq]);
+		fill_attacks(sq, BBits[sq], 0, bishopMasks[sq], bishopMagics[sq], bishopAttacksPtr[sq]);
+	}
+}
+
+// Default startup: load the precomputed magics (see magictables.c)
+void init_magic_bitboards() {
+	init_magic_layout();
+	memcpy(rookMagics, precomputedRookMagics, sizeof(rookMagics));
+	memcpy(bishopMagics, precomputedBishopMagics, sizeof(bishopMagics));
+	fill_all_attacks();
+}
+
+// Opt-in startup: brute-force search for fresh magics (slow)
+void regen_magic_bitboards() {
+	init_magic_layout();
 	for (square sq = h1; sq <= a8; sq++) {
 		rookMagics[sq] = find_magic(sq, RBits[sq], 1, rookMasks);
 	}
 	for (square sq = h1; sq <= a8; sq++) {
 		bishopMagics[sq] = find_magic(sq, BBits[sq], 0, bishopMasks);
 	}
+	fill_all_attacks();
+}
+
+// Prints the current magics as the source of magictables.c, so that
+// "./aldan --regen-magics > magictables.c" regenerates the embedded tables
+void print_magic_tables(FILE *out) {
+	fprintf(out, "#include \"chess.h\"\n\n");
+	fprintf(out, "// Generated by \"./aldan --regen-magics\" (see magic.c), do not edit by hand\n\n");
+	fprintf(out, "const U64 precomputedRookMagics[64] = {\n");
+	for (square sq = h1; sq <= a8; sq++) {
+		fprintf(out, "    0x%016llxULL,\n", rookMagics[sq]);
+	}
+	fprintf(out, "};\n\n");
+	fprintf(out, "const U64 precomputedBishopMagics[64] = {\n");
+	for (square sq = h1; sq <= a8; sq++) {
+		fprintf(out, "    0x%016llxULL,\n", bishopMagics[sq]);
+	}
+	fprintf(out, "};\n");
 }
 
 U64 magicRookAttacks(square rook_sq, U64 occupancy) {
-    return rookAttacksTable[rook_sq][get_magic_key(occupancy & rookMasks[rook_sq], rookMagics[rook_sq], RBits[rook_sq])];
+    return rookAttacksPtr[rook_sq][attack_index(occupancy, rookMasks[rook_sq], rookMagics[rook_sq], RBits[rook_sq])];
 }
 
 U64 magicBishopAttacks(square bishop_sq, U64 occupancy) {
-	return bishopAttacksTable[bishop_sq][get_magic_key(occupancy & bishopMasks[bishop_sq], bishopMagics[bishop_sq], BBits[bishop_sq])];
+	return bishopAttacksPtr[bishop_sq][attack_index(occupancy, bishopMasks[bishop_sq], bishopMagics[bishop_sq], BBits[bishop_sq])];
 }
 
 U64 magicQueenAttacks(square queen_sq, U64 occupancy) {
 	return (magicBishopAttacks(queen_sq, occupancy) | magicRookAttacks(queen_sq, occupancy));
-}
\ No newline at end of file
+}
\ No newline at end of file
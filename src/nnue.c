@@ -0,0 +1,353 @@
+#include "chess.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+  _______________________________________
+ /                                       \
+/   _   _   _                 _   _   _   \
+|  | |_| |_| |   _   _   _   | |_| |_| |  |
+|   \   _   /   | |_| |_| |   \   _   /   |
+|    | | | |     \       /     | | | |    |
+|    | |_| |______|     |______| |_| |    |
+|    |              ___              |    |
+|    |  _    _    (     )    _    _  |    |
+|    | | |  |_|  (       )  |_|  | | |    |
+|    | |_|       |       |       |_| |    |
+|   /            |_______|            \   |
+|  |___________________________________|  |
+\             Computer Chess              /
+ \_______________________________________/
+
+===========================================
+-------------------------------------------
+            NNUE EVALUATION
+-------------------------------------------
+===========================================
+
+An alternative to the hand-written evaluation in eval.c: a small neural
+network, "efficiently updatable" (NNUE) because nearly all of its work is in a
+first layer whose inputs barely change from one move to the next.
+
+The inputs are one per (piece, color, square), 768 in all, which are 1 if that
+piece is on that square and 0 otherwise. They are seen from each side's point
+of view in turn: for black, the board is flipped and the colors swapped, so
+that "own pawn on e2" means the same thing to both. The first layer (the
+feature transformer) turns each side's inputs into NNUE_HIDDEN numbers, the
+accumulator, which is just the sum of the weight rows of the pieces on the
+board (plus a bias). A move only takes a piece off a square and puts one on
+another (two of each at most, for captures and castling), so makeMove keeps
+both accumulators up to date by adding and subtracting a few rows, and
+unmakeMove does the opposite.
+
+The output layer then takes the side to move's accumulator followed by the
+other side's, each clipped to 0..NNUE_QA ("clipped ReLU"), and gives the score
+as their dot product with its weights.
+
+All weights are integers: the feature transformer's are scaled by NNUE_QA and
+the output layer's by NNUE_QB, so that the score comes out in units of
+NNUE_QA * NNUE_QB per NNUE_SCALE centipawns.
+
+The network file is the following, all little-endian, and is mapped into
+memory (map_file in interface.c) rather than read, so that loading it costs
+next to nothing:
+- the 8 bytes "ALDANNUE", then the number of inputs (768) and of hidden
+  neurons (NNUE_HIDDEN), each as a 32-bit int
+- feature transformer weights: 768 rows of NNUE_HIDDEN 16-bit ints, row
+  (side * 6 + piece) * 64 + square, where side is 0 for the point of view's
+  own pieces and the square is flipped for black
+- feature transformer biases: NNUE_HIDDEN 16-bit ints
+- output weights: 2 * NNUE_HIDDEN 16-bit ints (side to move first)
+- output bias: one 32-bit int, scaled by NNUE_QA * NNUE_QB
+
+*/
+
+#define NNUE_INPUTS 768
+#define NNUE_QA 255
+#define NNUE_QB 64
+#define NNUE_SCALE 400
+#define NNUE_MAGIC "ALDANNUE"
+#define NNUE_HEADER_SIZE 16
+#define NNUE_FILE_SIZE                                                         \
+    (NNUE_HEADER_SIZE + 2 * (NNUE_INPUTS * NNUE_HIDDEN + NNUE_HIDDEN) +        \
+     2 * (2 * NNUE_HIDDEN) + 4)
+
+// The network, pointing into the mapped file
+typedef struct network_t {
+    const int16_t *ft_weights; // [NNUE_INPUTS][NNUE_HIDDEN]
+    const int16_t *ft_biases;  // [NNUE_HIDDEN]
+    const int16_t *out_weights; // [2][NNUE_HIDDEN]
+    int32_t out_bias;
+} network;
+
+static network net;
+static int net_loaded = 0;
+int nnue_enabled = 0;
+
+/*
+
+Vector kernels: the accumulator updates and the output layer are the same few
+operations on 16-bit lanes whatever the instruction set, so each set only
+defines those operations, and the loops below are shared. x86-64 always has
+SSE2 (which has everything needed here), and AVX2 doubles the width when the
+compiler is allowed to use it (e.g. make DEFS=-mavx2); ARM uses NEON. Anything
+else falls back to plain loops.
+
+*/
+#if defined(__AVX2__)
+#define NNUE_KERNELS "AVX2"
+#define VEC_SHORTS 16
+typedef __m256i vec16;
+typedef __m256i vec32;
+#define vecLoad(p) _mm256_loadu_si256((const __m256i *)(p))
+#define vecStore(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+#define vecAdd16(a, b) _mm256_add_epi16((a), (b))
+#define vecSub16(a, b) _mm256_sub_epi16((a), (b))
+#define vecClip16(v, zero, max)                                                \
+    _mm256_min_epi16(_mm256_max_epi16((v), (zero)), (max))
+#define vecSet16(x) _mm256_set1_epi16(x)
+#define vecZero32() _mm256_setzero_si256()
+// Multiplies 16-bit lanes, adding neighbouring products into 32-bit lanes
+#define vecMulAdd(sum, a, b) _mm256_add_epi32((sum), _mm256_madd_epi16((a), (b)))
+static int vecSum32(vec32 v) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v),
+                                _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+#elif defined(__SSE2__)
+#define NNUE_KERNELS "SSE2"
+#define VEC_SHORTS 8
+typedef __m128i vec16;
+typedef __m128i vec32;
+#define vecLoad(p) _mm_loadu_si128((const __m128i *)(p))
+#define vecStore(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+#define vecAdd16(a, b) _mm_add_epi16((a), (b))
+#define vecSub16(a, b) _mm_sub_epi16((a), (b))
+#define vecClip16(v, zero, max) _mm_min_epi16(_mm_max_epi16((v), (zero)), (max))
+#define vecSet16(x) _mm_set1_epi16(x)
+#define vecZero32() _mm_setzero_si128()
+#define vecMulAdd(sum, a, b) _mm_add_epi32((sum), _mm_madd_epi16((a), (b)))
+static int vecSum32(vec32 v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4E));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xB1));
+    return _mm_cvtsi128_si32(v);
+}
+#elif defined(__ARM_NEON)
+#define NNUE_KERNELS "NEON"
+#define VEC_SHORTS 8
+typedef int16x8_t vec16;
+typedef int32x4_t vec32;
+#define vecLoad(p) vld1q_s16(p)
+#define vecStore(p, v) vst1q_s16((p), (v))
+#define vecAdd16(a, b) vaddq_s16((a), (b))
+#define vecSub16(a, b) vsubq_s16((a), (b))
+#define vecClip16(v, zero, max) vminq_s16(vmaxq_s16((v), (zero)), (max))
+#define vecSet16(x) vdupq_n_s16(x)
+#define vecZero32() vdupq_n_s32(0)
+#define vecMulAdd(sum, a, b)                                                   \
+    vmlal_s16(vmlal_s16((sum), vget_low_s16(a), vget_low_s16(b)),              \
+              vget_high_s16(a), vget_high_s16(b))
+static int vecSum32(vec32 v) {
+    int32x2_t sum = vadd_s32(vget_low_s32(v), vget_high_s32(v));
+    return vget_lane_s32(vpadd_s32(sum, sum), 0);
+}
+#else
+#define NNUE_KERNELS "scalar"
+#endif
+
+// Adds some weight rows to an accumulator and takes others away, in one pass
+static void updateAccumulator(int16_t *acc, const int16_t **added, int n_added,
+                              const int16_t **removed, int n_removed) {
+#ifdef VEC_SHORTS
+    for (int i = 0; i < NNUE_HIDDEN; i += VEC_SHORTS) {
+        vec16 v = vecLoad(acc + i);
+        for (int j = 0; j < n_added; j++) {
+            v = vecAdd16(v, vecLoad(added[j] + i));
+        }
+        for (int j = 0; j < n_removed; j++) {
+            v = vecSub16(v, vecLoad(removed[j] + i));
+        }
+        vecStore(acc + i, v);
+    }
+#else
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int16_t v = acc[i];
+        for (int j = 0; j < n_added; j++) {
+            v += added[j][i];
+        }
+        for (int j = 0; j < n_removed; j++) {
+            v -= removed[j][i];
+        }
+        acc[i] = v;
+    }
+#endif
+}
+
+// Dot product of a clipped accumulator with a row of output weights
+static int outputSum(const int16_t *acc, const int16_t *weights) {
+#ifdef VEC_SHORTS
+    vec16 zero = vecSet16(0);
+    vec16 max = vecSet16(NNUE_QA);
+    vec32 sum = vecZero32();
+    for (int i = 0; i < NNUE_HIDDEN; i += VEC_SHORTS) {
+        vec16 clipped = vecClip16(vecLoad(acc + i), zero, max);
+        sum = vecMulAdd(sum, clipped, vecLoad(weights + i));
+    }
+    return vecSum32(sum);
+#else
+    int sum = 0;
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int clipped = acc[i] < 0 ? 0 : (acc[i] > NNUE_QA ? NNUE_QA : acc[i]);
+        sum += clipped * weights[i];
+    }
+    return sum;
+#endif
+}
+
+// Weight row of a colored piece on a square, from one side's point of view
+static const int16_t *featureRow(int perspective, int colored_piece,
+                                 square sq) {
+    int side = (colored_piece & 1) ^ perspective;
+    int logical_sq = (perspective == WHITE) ? sq : (sq ^ 56);
+    int feature = (side * 6 + (colored_piece >> 1)) * 64 + logical_sq;
+    return net.ft_weights + feature * NNUE_HIDDEN;
+}
+
+void nnue_refresh(game_state *gs) {
+    if (!net_loaded) {
+        return;
+    }
+    for (int perspective = WHITE; perspective <= BLACK; perspective++) {
+        int16_t *acc = gs->accumulator[perspective];
+        memcpy(acc, net.ft_biases, NNUE_HIDDEN * sizeof(int16_t));
+        for (square sq = h1; sq <= a8; sq++) {
+            if (gs->board[sq] != NO_PIECE) {
+                const int16_t *row = featureRow(perspective, gs->board[sq], sq);
+                updateAccumulator(acc, &row, 1, NULL, 0);
+            }
+        }
+    }
+}
+
+// Applies the pieces a move puts on and takes off the board to both
+// accumulators, or (undoing it) the reverse. Everything needed is in the move
+// itself, so this works the same before or after the bitboards change
+static void applyMove(game_state *gs, int move, int color, int undoing) {
+    int foe = 1 - color;
+    square source = decodeSource(move);
+    square dest = decodeDest(move);
+    piece piec = decodePiece(move);
+    piece promoteTo = decodePromote(move);
+    // Colored piece and square of each piece put on or taken off
+    int on_piece[2], off_piece[2];
+    square on_sq[2], off_sq[2];
+    int n_on = 1, n_off = 1;
+    off_piece[0] = 2 * piec + color;
+    off_sq[0] = source;
+    on_piece[0] = 2 * (promoteTo ? promoteTo : piec) + color;
+    on_sq[0] = dest;
+    if (decodeCapture(move)) {
+        off_piece[n_off] = 2 * decodeCapturedPiece(move) + foe;
+        off_sq[n_off++] = dest;
+    }
+    if (decodeEnPassant(move)) {
+        off_piece[n_off] = 2 * pawn + foe;
+        off_sq[n_off++] = color ? dest + 8 : dest - 8;
+    }
+    if (decodeCastle(move)) {
+        // As in makeMove: the rook goes from its corner to the square the king
+        // passed over
+        int direction = dest > source;
+        off_piece[n_off] = 2 * rook + color;
+        off_sq[n_off++] = 7 * direction + 56 * color;
+        on_piece[n_on] = 2 * rook + color;
+        on_sq[n_on++] = (source > dest ? source : dest) - 1;
+    }
+    for (int perspective = WHITE; perspective <= BLACK; perspective++) {
+        const int16_t *on_rows[2], *off_rows[2];
+        for (int i = 0; i < n_on; i++) {
+            on_rows[i] = featureRow(perspective, on_piece[i], on_sq[i]);
+        }
+        for (int i = 0; i < n_off; i++) {
+            off_rows[i] = featureRow(perspective, off_piece[i], off_sq[i]);
+        }
+        if (undoing) {
+            updateAccumulator(gs->accumulator[perspective], off_rows, n_off,
+                              on_rows, n_on);
+        } else {
+            updateAccumulator(gs->accumulator[perspective], on_rows, n_on,
+                              off_rows, n_off);
+        }
+    }
+}
+
+void nnue_make_move(game_state *gs, int move, int color) {
+    applyMove(gs, move, color, 0);
+}
+
+void nnue_unmake_move(game_state *gs, int move, int color) {
+    applyMove(gs, move, color, 1);
+}
+
+int nnue_evaluate(game_state *gs) {
+    int us = gs->whose_turn;
+    int sum = outputSum(gs->accumulator[us], net.out_weights) +
+              outputSum(gs->accumulator[1 - us], net.out_weights + NNUE_HIDDEN);
+    int score = (int)(((long long)sum + net.out_bias) * NNUE_SCALE /
+                      (NNUE_QA * NNUE_QB));
+    // Keep clear of the mate and tablebase scores, whatever the network says
+    if (score >= TB_WIN_BOUND) {
+        score = TB_WIN_BOUND - 1;
+    } else if (score <= -TB_WIN_BOUND) {
+        score = -TB_WIN_BOUND + 1;
+    }
+    return score;
+}
+
+static mapped_file net_file;
+
+int nnue_load(const char *path) {
+    unmap_file(&net_file);
+    net_loaded = 0;
+    nnue_enabled = 0;
+    if (map_file(path, &net_file)) {
+        return -1;
+    }
+    const unsigned char *data = net_file.data;
+    int32_t inputs = 0, hidden = 0;
+    if (net_file.size == NNUE_FILE_SIZE) {
+        memcpy(&inputs, data + 8, sizeof(inputs));
+        memcpy(&hidden, data + 12, sizeof(hidden));
+    }
+    if ((inputs != NNUE_INPUTS) || (hidden != NNUE_HIDDEN) ||
+        memcmp(data, NNUE_MAGIC, 8)) {
+        unmap_file(&net_file);
+        return -1;
+    }
+    const int16_t *weights = (const int16_t *)(data + NNUE_HEADER_SIZE);
+    net.ft_weights = weights;
+    net.ft_biases = net.ft_weights + NNUE_INPUTS * NNUE_HIDDEN;
+    net.out_weights = net.ft_biases + NNUE_HIDDEN;
+    memcpy(&net.out_bias, net.out_weights + 2 * NNUE_HIDDEN,
+           sizeof(net.out_bias));
+    net_loaded = 1;
+    return 0;
+}
+
+int nnue_set_enabled(int enabled) {
+    nnue_enabled = enabled && net_loaded;
+    return nnue_enabled;
+}
+
+int nnue_loaded() { return net_loaded; }
+
+const char *nnue_kernels() { return NNUE_KERNELS; }
@@ -2,6 +2,8 @@
 #include "chess.h"
 #include <ctype.h>
 #include <limits.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,102 +39,705 @@ the best move for the opponent.
 #define EXACT 0
 #define ALPHA 1
 #define BETA 2
-int alphaBeta(game_state *gs, int mg_table[12][64], int eg_table[12][64],
-              int alpha, int beta, int depth, U64 hash) {
+
+/*
+
+To tell whether the search is doing its job (and to tune it), we need to know
+what it did: how many nodes it visited, how often the hash table saved us a
+search, and how good our move ordering is. The last is measured by how many
+beta cutoffs come from the first move tried, since with perfect ordering every
+cutoff would. All of this is counted in a search_info, which is passed down the
+tree alongside the game state.
+
+*/
+
+void clear_search_info(search_info *info) {
+    memset(info, 0, sizeof(search_info));
+    info->params = &default_search_params;
+}
+
+// Probes the hash table, counting the probe
+static int probe_hash_table(U64 hash, int *score, int depth, int alpha,
+                            int beta, int ply, search_info *info) {
+    info->tt_probes++;
+    PROFILE_BEGIN(start);
+    int result = get_eval(hash, score, depth, alpha, beta, ply);
+    PROFILE_END(start, PHASE_TT_PROBE);
+    if (result != TT_MISS) {
+        info->tt_hits++;
+    }
+    if (result == TT_USABLE) {
+        info->tt_cutoffs++;
+    }
+    return result;
+}
+
+/*
+
+Alpha-beta prunes best when the best move is searched first: then every other
+move only has to be shown to be worse, which is quick. So before searching, we
+score every move and try them in this order:
+
+- The move stored in the hash table for this position. It was the best move
+  the last time we searched here (e.g. at the previous depth of the iterative
+  deepening), so it's likely to be best again.
+- Captures (and promotions), most valuable victim first, then least valuable
+  attacker first (MVV-LVA): pawn takes queen before queen takes pawn.
+- Killer moves: quiet moves which caused a cutoff at the same ply elsewhere in
+  the tree. Sibling positions tend to have the same refutations.
+- All other quiet moves, by their history: how much they've caused cutoffs
+  anywhere in the tree, weighted by depth so cutoffs near the root count more.
+
+Rather than sorting the whole list, we pick the best remaining move each time,
+since after a cutoff the rest of the list is never looked at.
+
+Better still, we don't generate moves until we need them (see movePicker
+below), since often the hash move or a capture causes a cutoff before the
+quiet moves are ever looked at.
+
+*/
+#define HASH_MOVE_SCORE 1000000
+#define CAPTURE_SCORE 100000
+#define KILLER_SCORE 90000
+// History scores are halved when one reaches this, so they stay below killers
+#define HISTORY_MAX 50000
+
+static int isQuiet(int move) {
+    return !decodeCapture(move) && !decodeEnPassant(move) &&
+           (decodePromote(move) == pawn);
+}
+
+static void scoreMoves(game_state *gs, compact_moves *move_list, int scores[],
+                       int hash_move, int ply, search_info *info) {
+    for (int i = 0; i < move_list->count; i++) {
+        int move = expandMove(gs, move_list->moves[i]);
+        if (move == hash_move) {
+            scores[i] = HASH_MOVE_SCORE;
+        } else if (!isQuiet(move)) {
+            // En-passant captures take a pawn (but aren't flagged as captures)
+            int victim = decodeCapture(move) ? decodeCapturedPiece(move) : pawn;
+            int promotion = decodePromote(move);
+            scores[i] = CAPTURE_SCORE + 16 * (victim + promotion) -
+                        decodePiece(move);
+        } else if ((ply < MAX_PLY) && (move == info->killers[ply][0])) {
+            scores[i] = KILLER_SCORE + 1;
+        } else if ((ply < MAX_PLY) && (move == info->killers[ply][1])) {
+            scores[i] = KILLER_SCORE;
+        } else {
+            scores[i] = info->history[2 * decodePiece(move) + decodeTurn(move)]
+                                     [decodeDest(move)];
+        }
+    }
+}
+
+// Swaps the best-scored move at or after index i into index i, returning it
+// (expanded)
+static int pickMove(game_state *gs, compact_moves *move_list, int scores[],
+                    int i) {
+    int best = i;
+    for (int j = i + 1; j < move_list->count; j++) {
+        if (scores[j] > scores[best]) {
+            best = j;
+        }
+    }
+    unsigned short move = move_list->moves[best];
+    int score = scores[best];
+    move_list->moves[best] = move_list->moves[i];
+    scores[best] = scores[i];
+    move_list->moves[i] = move;
+    scores[i] = score;
+    return expandMove(gs, move);
+}
+
+// Remembers a quiet move which caused a cutoff, as a killer at this ply and in
+// the history table
+static void updateOrdering(int move, int depth, int ply, search_info *info) {
+    if (!isQuiet(move)) {
+        return;
+    }
+    if ((ply < MAX_PLY) && (move != info->killers[ply][0])) {
+        info->killers[ply][1] = info->killers[ply][0];
+        info->killers[ply][0] = move;
+    }
+    int *entry =
+        &info->history[2 * decodePiece(move) + decodeTurn(move)][decodeDest(move)];
+    *entry += depth * depth;
+    if (*entry >= HISTORY_MAX) {
+        for (int i = 0; i < 12; i++) {
+            for (int sq = 0; sq < 64; sq++) {
+                info->history[i][sq] /= 2;
+            }
+        }
+    }
+}
+
+/*
+
+The move picker hands out a node's moves one at a time, in stages, only
+generating each kind of move once the previous stages are used up:
+- the hash move, checked for legality (the hash table may be wrong) without
+  generating anything else
+- captures which don't lose material by static exchange evaluation, by
+  MVV-LVA
+- the killers, again just checked for legality
+- the quiet moves, by history
+- finally, the captures which seemed to lose material
+Moves already handed out by an earlier stage are skipped.
+
+*/
+#define STAGE_HASH_MOVE 0
+#define STAGE_GEN_CAPTURES 1
+#define STAGE_GOOD_CAPTURES 2
+#define STAGE_KILLERS 3
+#define STAGE_GEN_QUIETS 4
+#define STAGE_QUIETS 5
+#define STAGE_BAD_CAPTURES 6
+#define STAGE_DONE 7
+
+typedef struct movePicker_t {
+    int stage;
+    int hash_move;
+    int killers[2];
+    int ply;
+    // Moves of the current stage, their scores and the losing captures (this
+    // ply's lists in the search_info), and the next to hand out
+    ply_moves *pm;
+    int index;
+} move_picker;
+
+static void initPicker(move_picker *mp, int hash_move, int ply,
+                       search_info *info) {
+    mp->stage = STAGE_HASH_MOVE;
+    mp->hash_move = hash_move;
+    mp->ply = ply;
+    mp->killers[0] = (ply < MAX_PLY) ? info->killers[ply][0] : NULLMOVE;
+    mp->killers[1] = (ply < MAX_PLY) ? info->killers[ply][1] : NULLMOVE;
+    mp->pm = &info->move_stack[ply];
+    mp->pm->bad_captures.count = 0;
+}
+
+// Returns the next move to search, or NULLMOVE once there are none left
+static int nextMove(move_picker *mp, game_state *gs, search_info *info) {
+    int move;
+    switch (mp->stage) {
+    case STAGE_HASH_MOVE:
+        mp->stage = STAGE_GEN_CAPTURES;
+        if (isLegalMove(gs, mp->hash_move)) {
+            return mp->hash_move;
+        }
+        // fall through
+    case STAGE_GEN_CAPTURES:
+        generateCompact(&mp->pm->move_list, gs, GEN_CAPTURES);
+        scoreMoves(gs, &mp->pm->move_list, mp->pm->scores, NULLMOVE, mp->ply,
+                   info);
+        mp->index = 0;
+        mp->stage = STAGE_GOOD_CAPTURES;
+        // fall through
+    case STAGE_GOOD_CAPTURES:
+        while (mp->index < mp->pm->move_list.count) {
+            move = pickMove(gs, &mp->pm->move_list, mp->pm->scores,
+                            mp->index++);
+            if (move == mp->hash_move) {
+                continue;
+            }
+            if (see(gs, move) < 0) {
+                mp->pm->bad_captures.moves[mp->pm->bad_captures.count++] =
+                    compactMove(move);
+                continue;
+            }
+            return move;
+        }
+        mp->index = 0;
+        mp->stage = STAGE_KILLERS;
+        // fall through
+    case STAGE_KILLERS:
+        while (mp->index < 2) {
+            move = mp->killers[mp->index++];
+            if ((move != mp->hash_move) && isLegalMove(gs, move)) {
+                return move;
+            }
+        }
+        mp->stage = STAGE_GEN_QUIETS;
+        // fall through
+    case STAGE_GEN_QUIETS:
+        generateCompact(&mp->pm->move_list, gs, GEN_QUIETS);
+        scoreMoves(gs, &mp->pm->move_list, mp->pm->scores, NULLMOVE, mp->ply,
+                   info);
+        mp->index = 0;
+        mp->stage = STAGE_QUIETS;
+        // fall through
+    case STAGE_QUIETS:
+        while (mp->index < mp->pm->move_list.count) {
+            move = pickMove(gs, &mp->pm->move_list, mp->pm->scores,
+                            mp->index++);
+            if ((move == mp->hash_move) || (move == mp->killers[0]) ||
+                (move == mp->killers[1])) {
+                continue;
+            }
+            return move;
+        }
+        mp->index = 0;
+        mp->stage = STAGE_BAD_CAPTURES;
+        // fall through
+    case STAGE_BAD_CAPTURES:
+        if (mp->index < mp->pm->bad_captures.count) {
+            return expandMove(gs, mp->pm->bad_captures.moves[mp->index++]);
+        }
+        mp->stage = STAGE_DONE;
+        // fall through
+    default:
+        return NULLMOVE;
+    }
+}
+
+/*
+
+Stopping the search at a fixed depth and evaluating is dangerous: if the last
+move searched was QxP, the evaluation sees a pawn won, not that the queen is
+about to be recaptured (the "horizon effect"). So at depth 0 we don't evaluate
+straight away, but keep searching captures only until the position is quiet
+(quiescence search).
+
+The side to move doesn't have to capture, so the static evaluation is a lower
+bound on its score ("standing pat"): if that alone beats beta, we're done.
+Beyond that, we skip captures which can't matter:
+- delta pruning: even winning the captured piece (plus a margin) would leave
+  us below alpha
+- captures which lose material by static exchange evaluation (see()), e.g.
+  QxP when the pawn is defended
+
+When in check, standing pat isn't an option, so every evasion is searched
+(and having none is checkmate).
+
+*/
+#define DELTA_MARGIN 200
+
+/*
+
+A search can be told to stop part way through, either from outside (the UCI
+"stop", running on another thread) or, for helper threads, once the main
+thread's search is over, by setting a flag shared by every thread. Reading it
+is cheap but not free, so each thread only looks every few thousand nodes, and
+then remembers the answer in its search_info. A stopped search unwinds straight
+away, and nothing it finds from then on (scores, moves or hash entries) can be
+trusted, so none of it is kept. The first iteration is always finished, so that
+there is a move to play.
+
+The same goes for pondering (searching on the opponent's time, on the move we
+expect them to play): the search has no time limit until the GUI says that the
+move was played ("ponderhit"), from which point its time counts.
+
+*/
+#define STOP_CHECK_NODES 4096
+
+// Set by stop_searching, and for the helpers by the main thread
+static int stop_requested = 0;
+static int helpers_stop = 0;
+static int pondering = 0;
+// When the search's time started counting
+static int search_start_ms = 0;
+
+// Past the hard time limit (never while pondering)
+static int outOfTime(search_limits *limits) {
+    return (limits->hard_ms >= 0) &&
+           !__atomic_load_n(&pondering, __ATOMIC_RELAXED) &&
+           (get_time_ms() - __atomic_load_n(&search_start_ms,
+                                            __ATOMIC_RELAXED) >
+            limits->hard_ms);
+}
+
+static int searchStopped(search_info *info) {
+    if (info->stopped || (info->depth == 0)) {
+        return info->stopped;
+    }
+    U64 nodes = info->nodes + info->qnodes;
+    search_limits *limits = info->limits;
+    // The node limit is checked every time, so that it is exact
+    if (limits && limits->nodes && (nodes >= limits->nodes)) {
+        info->stopped = 1;
+    } else if ((nodes % STOP_CHECK_NODES) == 0) {
+        info->stopped = __atomic_load_n(&stop_requested, __ATOMIC_RELAXED) ||
+                        __atomic_load_n(&helpers_stop, __ATOMIC_RELAXED) ||
+                        (limits && outOfTime(limits));
+    }
+    return info->stopped;
+}
+
+// Called before starting a search on another thread, which then ponders (or
+// searches with no time limit) if ponder is set
+void prepare_search(int ponder) {
+    __atomic_store_n(&stop_requested, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pondering, ponder, __ATOMIC_RELAXED);
+}
+
+// Tells the search under way (if any) to stop as soon as it can
+void stop_searching() {
+    __atomic_store_n(&stop_requested, 1, __ATOMIC_RELAXED);
+}
+
+// The expected move was played: the ponder search turns into a normal one,
+// whose time starts now
+void ponderhit() {
+    __atomic_store_n(&search_start_ms, get_time_ms(), __ATOMIC_RELAXED);
+    __atomic_store_n(&pondering, 0, __ATOMIC_RELAXED);
+}
+
+static int quiescence(game_state *gs, int alpha, int beta, int ply,
+                      search_info *info) {
+    info->qnodes++;
+    if (searchStopped(info)) {
+        return 0;
+    }
+    int in_check = inCheck(gs);
+    int stand_pat = evaluate(gs);
+    if (ply >= MAX_PLY) {
+        return stand_pat;
+    }
+    // Captures aren't part of the principal variation
+    info->pv_length[ply] = 0;
+    if (!in_check) {
+        if (stand_pat >= beta) {
+            return beta;
+        }
+        if (stand_pat > alpha) {
+            alpha = stand_pat;
+        }
+    }
+    compact_moves *move_list = &info->move_stack[ply].move_list;
+    int *scores = info->move_stack[ply].scores;
+    undo_info undo;
+    if (in_check) {
+        generateCompact(move_list, gs, GEN_ALL);
+        if (move_list->count == 0) {
+            return -MATE + ply;
+        }
+    } else {
+        generateCompact(move_list, gs, GEN_CAPTURES);
+    }
+    scoreMoves(gs, move_list, scores, NULLMOVE, ply, info);
+    for (int i = 0; i < move_list->count; i++) {
+        int move = pickMove(gs, move_list, scores, i);
+        if (!in_check) {
+            int promotion = decodePromote(move) != pawn;
+            int victim = decodeCapture(move) ? decodeCapturedPiece(move) : pawn;
+            if (!promotion &&
+                (stand_pat + seeValue[victim] + DELTA_MARGIN <= alpha)) {
+                continue;
+            }
+            if (!promotion && (see(gs, move) < 0)) {
+                continue;
+            }
+        }
+        makeMove(move, gs, &undo);
+        int score = -quiescence(gs, -beta, -alpha, ply + 1, info);
+        unmakeMove(move, gs, &undo);
+        if (info->stopped) {
+            return 0;
+        }
+        if (score >= beta) {
+            return beta;
+        }
+        if (score > alpha) {
+            alpha = score;
+        }
+    }
+    return alpha;
+}
+
+/*
+
+Principal variation search: with good ordering, the first move searched at a
+node is usually the best, so the rest are only searched with a null window
+(alpha, alpha + 1), which can prove a move worse than the best so far much more
+cheaply than a full search. A move which turns out better is searched again
+with the full window to find its exact score.
+
+Whenever a move raises alpha, its line is recorded in a triangular table: the
+line at a ply is the move followed by the line from the next ply. At the root,
+that is the principal variation, which the next iteration searches first.
+
+*/
+// Records move, followed by the line below it, as the best line from ply
+static void updatePV(search_info *info, int ply, int move) {
+    if (ply >= MAX_PLY) {
+        return;
+    }
+    info->pv[ply][0] = move;
+    int length = 1;
+    if (ply + 1 < MAX_PLY) {
+        for (int i = 0; i < info->pv_length[ply + 1] && length < MAX_PLY;
+             i++) {
+            info->pv[ply][length++] = info->pv[ply + 1][i];
+        }
+    }
+    info->pv_length[ply] = length;
+}
+
+/*
+
+Selective search: alphaBeta alone searches every move to the same depth, but
+most of the tree is spent refuting moves no sane player would make. Three
+well-known tricks cut it down, each switchable at compile time (e.g.
+make DEFS=-DUSE_LMR=0) so its effect can be measured with the bench. Which are
+on, and their margins, are then the defaults for a search's search_params,
+which a single search can change, so that two sets can play each other in one
+process (see selfplay.c):
+
+- Null-move pruning: if we could pass and still be above beta after a reduced
+  search, a real move will almost surely be too, so we cut straight away.
+  Passing is only a good guess when a move can't be worse than passing, which
+  fails in zugzwang, mostly in pawn endings, so it needs a piece to move and
+  isn't done twice in a row or when in check.
+- Late move reductions: with good ordering, moves late in the list rarely
+  raise alpha, so late quiet moves are searched with less depth (more the
+  deeper and later they are), and again at full depth only if they do.
+- Futility pruning: near the leaves, if the static evaluation is so far below
+  alpha that a quiet move can't plausibly make up the difference, it isn't
+  searched. Reversed, if the evaluation is so far above beta that even a
+  margin of loss keeps it there, the node is cut without searching.
+
+*/
+#ifndef USE_NULL_MOVE
+#define USE_NULL_MOVE 1
+#endif
+#ifndef USE_LMR
+#define USE_LMR 1
+#endif
+#ifndef USE_FUTILITY
+#define USE_FUTILITY 1
+#endif
+#define NULL_MOVE_DEPTH 3
+#define NULL_MOVE_REDUCTION 2
+#define LMR_DEPTH 3
+#define LMR_MOVES 3
+#define FUTILITY_DEPTH 3
+#define FUTILITY_MARGIN 120
+
+const search_params default_search_params = {
+    USE_NULL_MOVE, NULL_MOVE_REDUCTION, USE_LMR, USE_FUTILITY, FUTILITY_MARGIN};
+
+// Late move reductions by depth and number of moves already searched
+static int lmr_table[MAX_PLY][64];
+
+void init_search() {
+    for (int depth = 1; depth < MAX_PLY; depth++) {
+        for (int move = 1; move < 64; move++) {
+            lmr_table[depth][move] =
+                (int)(0.75 + log(depth) * log(move) / 2.25);
+        }
+    }
+}
+
+// Whether color has a piece besides its pawns and king, i.e. probably isn't
+// in zugzwang
+static int hasNonPawnMaterial(game_state *gs, int color) {
+    return (gs->piece_bb[2 * knight + color] | gs->piece_bb[2 * bishop + color] |
+            gs->piece_bb[2 * rook + color] | gs->piece_bb[2 * queen + color]) !=
+           0;
+}
+
+// Whether a score is too close to mate for margins to mean anything
+static int isMateScore(int score) {
+    return (score >= MATE_BOUND) || (score <= -MATE_BOUND);
+}
+
+// Searches to depth (allow_null is 0 straight after a null move)
+int alphaBeta(game_state *gs, int alpha, int beta, int depth, int ply,
+              int allow_null, search_info *info) {
     int score;
+    U64 hash = gs->hash;
+    // Only nodes with an open window can be on the principal variation
+    int pv_node = (beta - alpha > 1);
+    if (ply < MAX_PLY) {
+        info->pv_length[ply] = 0;
+    }
+    if (searchStopped(info)) {
+        return 0;
+    }
     // First, probe the hash table to see if we have already evaluated
-    // to the required depth
-    if (get_eval(hash, &score, depth, alpha, beta) == 0) {
+    // to the required depth (not on the principal variation, whose line the
+    // hash table would cut short)
+    if (!pv_node &&
+        probe_hash_table(hash, &score, depth, alpha, beta, ply, info) ==
+            TT_USABLE) {
         // If we did, immediately exit
         return score;
     }
     // Otherwise, calculate by hand
-    if (depth == 0) {
-        // For depth 0 (no move), do not update hash key
-        score = evaluate(gs, mg_table, eg_table);
-        update_hash_table(hash, score, 0, EXACT, NULLMOVE);
+    if (depth <= 0) {
+        return quiescence(gs, alpha, beta, ply, info);
+    }
+    if (ply >= MAX_PLY) {
+        return evaluate(gs);
+    }
+    // With few enough pieces, the tablebases know the score outright
+    if (syzygy_pieces && (__builtin_popcountll(gs->all_bb) <= syzygy_pieces) &&
+        syzygy_probe_wdl(gs, ply, &score)) {
+        info->tb_hits++;
+        update_hash_table(hash, score, depth, EXACT, NULLMOVE, ply);
         return score;
     }
-    moves move_list[256];
-    game_state save_file;
-    generateAllMoves(move_list, gs);
+    info->nodes++;
+    const search_params *params = info->params;
+    move_picker mp;
+    undo_info undo;
+    int in_check = inCheck(gs);
+    // Pruning is only done away from the principal variation and out of check
+    int can_prune = !pv_node && !in_check;
+    int static_eval = can_prune ? evaluate(gs) : 0;
+    // Reverse futility pruning
+    if (params->futility && can_prune && depth <= FUTILITY_DEPTH &&
+        !isMateScore(beta) &&
+        static_eval - params->futility_margin * depth >= beta) {
+        info->futility_prunes++;
+        return beta;
+    }
+    if (params->null_move && can_prune && allow_null &&
+        depth >= NULL_MOVE_DEPTH && static_eval >= beta &&
+        hasNonPawnMaterial(gs, gs->whose_turn)) {
+        int reduction = params->null_move_reduction + depth / 6;
+        makeNullMove(gs, &undo);
+        score = -alphaBeta(gs, -beta, -beta + 1, depth - 1 - reduction,
+                           ply + 1, 0, info);
+        unmakeNullMove(gs, &undo);
+        if (info->stopped) {
+            return 0;
+        }
+        if (score >= beta) {
+            info->null_cutoffs++;
+            return beta;
+        }
+    }
+    int futile = params->futility && can_prune && depth <= FUTILITY_DEPTH &&
+                 !isMateScore(alpha) &&
+                 static_eval + params->futility_margin * depth <= alpha;
+    PROFILE_BEGIN(tt_start);
+    int hash_move = get_hash_move(hash);
+    PROFILE_END(tt_start, PHASE_TT_PROBE);
+    // Along the previous iteration's line, its move goes first
+    int pv_move = NULLMOVE;
+    if (info->follow_pv) {
+        if (ply < info->pv_line_length) {
+            pv_move = info->pv_line[ply];
+            hash_move = pv_move;
+        } else {
+            info->follow_pv = 0;
+        }
+    }
+    initPicker(&mp, hash_move, ply, info);
     int currentFlag = ALPHA;
-    U64 currentHash;
-    int noMovesFlag = 1;
+    int best_move = NULLMOVE;
+    int moves_searched = 0;
+    int move;
     // Check moves and extract scores
-    for (int i = 0; i < move_list->count; i++) {
-        int move = move_list->moves[i];
-        // First, save position
-        saveGamestate(gs, &save_file);
-        // Next, make move
-        makeMove(move, gs);
-        // Make sure legal before continuing
-        if (!checkCheck(gs)) {
-            noMovesFlag = 0;
-            // Update hash before looking at new move
-            currentHash = update_hash(move, hash);
-            score = -alphaBeta(gs, mg_table, eg_table, -beta, -alpha, depth - 1,
-                               currentHash);
-            /*
-            printf("Depth %i\n", depth);
-            square source_sq = decodeSource(move_list->moves[i]);
-            square dest_sq = decodeDest(move_list->moves[i]);
-            printf("\t%s -> %s\t\t:\t%i\n", boardStringMap[source_sq],
-                   boardStringMap[dest_sq], score);
-            */
-            if (score >= beta) {
-                update_hash_table(hash, beta, depth, BETA, NULLMOVE);
-                return beta;
+    while ((move = nextMove(&mp, gs, info)) != NULLMOVE) {
+        // Only the line's own move keeps following it
+        if (move != pv_move) {
+            info->follow_pv = 0;
+        }
+        // Make move (always legal, so no need to check)
+        makeMove(move, gs, &undo);
+        // Checks are never pruned or reduced
+        int quiet = isQuiet(move) && !inCheck(gs);
+        if (futile && quiet && moves_searched > 0) {
+            unmakeMove(move, gs, &undo);
+            info->futility_prunes++;
+            continue;
+        }
+        int reduction = 0;
+        if (params->lmr && depth >= LMR_DEPTH && moves_searched >= LMR_MOVES &&
+            quiet && !in_check && move != mp.killers[0] &&
+            move != mp.killers[1]) {
+            reduction = lmr_table[depth][moves_searched < 64 ? moves_searched
+                                                              : 63];
+            // Reduce less on the principal variation, and never straight
+            // into the quiescence search
+            if (pv_node && reduction > 0) {
+                reduction--;
             }
-            if (score > alpha) {
-                currentFlag = EXACT;
-                alpha = score;
+            if (reduction > depth - 2) {
+                reduction = depth - 2;
+            }
+        }
+        if (moves_searched == 0) {
+            score = -alphaBeta(gs, -beta, -alpha, depth - 1, ply + 1, 1, info);
+        } else {
+            score = -alphaBeta(gs, -alpha - 1, -alpha, depth - 1 - reduction,
+                               ply + 1, 1, info);
+            if (reduction > 0 && score > alpha) {
+                info->lmr_researches++;
+                score = -alphaBeta(gs, -alpha - 1, -alpha, depth - 1, ply + 1,
+                                   1, info);
+            }
+            if (score > alpha && score < beta) {
+                info->pvs_researches++;
+                score = -alphaBeta(gs, -beta, -alpha, depth - 1, ply + 1, 1,
+                                   info);
             }
         }
+        info->follow_pv = 0;
+        /*
+        printf("Depth %i\n", depth);
+        square source_sq = decodeSource(move);
+        square dest_sq = decodeDest(move);
+        printf("\t%s -> %s\t\t:\t%i\n", boardStringMap[source_sq],
+               boardStringMap[dest_sq], score);
+        */
         // Undo move
-        undoPreviousMove(gs, &save_file);
-    }
-    update_hash_table(hash, score, depth, currentFlag, NULLMOVE);
-    // Check for stalemate: if we don't, then it is treated as checkmate (score
-    // = alpha)
-    if (noMovesFlag) {
-        // Either checkmate or stalemate
-        gs->whose_turn = 1 - gs->whose_turn;
-        if (!checkCheck(gs)) {
-            alpha = 0;
+        unmakeMove(move, gs, &undo);
+        if (info->stopped) {
+            return 0;
+        }
+        moves_searched++;
+        if (score >= beta) {
+            info->beta_cutoffs++;
+            if (moves_searched == 1) {
+                info->first_move_cutoffs++;
+            }
+            updateOrdering(move, depth, ply, info);
+            update_hash_table(hash, beta, depth, BETA, move, ply);
+            return beta;
+        }
+        if (score > alpha) {
+            currentFlag = EXACT;
+            alpha = score;
+            best_move = move;
+            updatePV(info, ply, move);
         }
-        gs->whose_turn = 1 - gs->whose_turn;
     }
+    // With no moves, it's checkmate (the sooner, the worse) or stalemate
+    if (moves_searched == 0) {
+        score = in_check ? -MATE + ply : 0;
+        update_hash_table(hash, score, depth, EXACT, NULLMOVE, ply);
+        return score;
+    }
+    update_hash_table(hash, alpha, depth, currentFlag, best_move, ply);
     return alpha;
 }
 
 /*
 // Combined minimax (negaMax)
-int negaMax(game_state *gs, int mg_table[12][64], int eg_table[12][64],
-            int alpha, int beta, int depth, U64 hash) {
+int negaMax(game_state *gs, int alpha, int beta, int depth, U64 hash) {
     // If at leaf node (max depth), return evaluation
     if (depth == 0)
-        return evaluate(gs, mg_table, eg_table);
+        return evaluate(gs);
     int max = -9999999;
     int score;
     moves move_list[256];
-    game_state save_file;
+    undo_info undo;
     generateAllMoves(move_list, gs);
     // For every move, find the optimum
     for (int i = 0; i < move_list->count; i++) {
         int move = move_list->moves[i];
-        // First, save position
-        saveGamestate(gs, &save_file);
-        // Next, make move
-        makeMove(move, gs);
+        // Make move
+        makeMove(move, gs, &undo);
         // Make sure legal before continuing
         if (!checkCheck(gs)) {
             // Check whether hash table holds an evaluation of sufficient depth
             U64 currentHash = update_hash(move, hash);
             if (get_eval(currentHash, &score, depth)) {
                 // Otherwise, calculate by hand...
-                score = -negaMax(gs, mg_table, eg_table, -beta, -alpha,
-                                 depth - 1, currentHash);
+                score = -negaMax(gs, -beta, -alpha, depth - 1, currentHash);
                 // ... and update hashtable
                 // TODO: fix this
                 // update_hash_table(currentHash, score, depth);
@@ -148,43 +753,61 @@ int negaMax(game_state *gs, int mg_table[12][64], int eg_table[12][64],
             }
         }
         // Undo move
-        undoPreviousMove(gs, &save_file);
+        unmakeMove(move, gs, &undo);
     }
     return max;
 }
 */
 
-// Find best move via negaMax (or alphaBeta)
-int findBestMove(game_state *gs, int mg_table[12][64], int eg_table[12][64],
-                 int depth, int *best_score) {
-    int max = -9999999;
-    int alpha = -9999999;
-    int beta = -alpha;
+// Searches the root within (alpha, beta): inside the window the score is
+// exact, and outside it only a bound, with the best move of those searched
+static int searchRoot(game_state *gs, int depth, int alpha, int beta,
+                      int *best_score, search_info *info) {
+    int original_alpha = alpha;
+    int max = -INF;
     int score;
-    moves move_list[256];
-    game_state save_file;
-    generateLegalMoves(move_list, gs);
-    int best_move = move_list->moves[0];
-    // Initialize hash here. Probably it would be (barely) faster to hold this
-    // in the main GUI loop and update after we make a move, so that we don't
-    // have to keep initializing on each turn, but I'm lazy and this is dwarfed
-    // by the actual search's compute time
-    U64 hash = current_pos_hash(gs);
+    compact_moves *move_list = &info->move_stack[0].move_list;
+    int *scores = info->move_stack[0].scores;
+    undo_info undo;
+    generateCompact(move_list, gs, GEN_ALL);
+    int best_move = NULLMOVE;
+    U64 hash = gs->hash;
+    info->nodes++;
+    info->pv_length[0] = 0;
+    // With no moves, it's checkmate or stalemate, and there's no move to play
+    if (move_list->count == 0) {
+        *best_score = inCheck(gs) ? -MATE : 0;
+        return NULLMOVE;
+    }
+    // The previous iteration's line goes first
+    int pv_move = NULLMOVE;
+    info->follow_pv = (info->pv_line_length > 0);
+    if (info->follow_pv) {
+        pv_move = info->pv_line[0];
+    }
+    scoreMoves(gs, move_list, scores,
+               pv_move != NULLMOVE ? pv_move : get_hash_move(hash), 0, info);
     // For every move, find the optimum
     for (int i = 0; i < move_list->count; i++) {
-        int move = move_list->moves[i];
-        // First, save position
-        saveGamestate(gs, &save_file);
-        // Next, make move
-        makeMove(move, gs);
-        // Check whether hash table holds an evaluation of sufficient depth
-        U64 currentHash = update_hash(move, hash);
-        if (get_eval(currentHash, &score, depth, alpha, beta) != 0) {
-            // Otherwise, calculate by hand
-            score = -alphaBeta(gs, mg_table, eg_table, -beta, -alpha, depth - 1,
-                               currentHash);
-        }
-        ///*
+        int move = pickMove(gs, move_list, scores, i);
+        if (move != pv_move) {
+            info->follow_pv = 0;
+        }
+        // Make move
+        makeMove(move, gs, &undo);
+        // alphaBeta checks the hash table itself. Later moves only need to be
+        // shown to be worse than the best so far
+        if (i == 0) {
+            score = -alphaBeta(gs, -beta, -alpha, depth - 1, 1, 1, info);
+        } else {
+            score = -alphaBeta(gs, -alpha - 1, -alpha, depth - 1, 1, 1, info);
+            if (score > alpha && score < beta) {
+                info->pvs_researches++;
+                score = -alphaBeta(gs, -beta, -alpha, depth - 1, 1, 1, info);
+            }
+        }
+        info->follow_pv = 0;
+        /*
         square source_sq = decodeSource(move_list->moves[i]);
         square dest_sq = decodeDest(move_list->moves[i]);
         printf("\t%s -> %s\t\t:\t%i\n", boardStringMap[source_sq],
@@ -192,50 +815,426 @@ int findBestMove(game_state *gs, int mg_table[12][64], int eg_table[12][64],
         //*/
 
         // Undo move
-        undoPreviousMove(gs, &save_file);
+        unmakeMove(move, gs, &undo);
+        if (info->stopped) {
+            return best_move;
+        }
         if (score > max) {
             max = score;
             best_move = move;
         }
+        if (score > alpha) {
+            alpha = score;
+            updatePV(info, 0, move);
+        }
+        // Failing high: the window was too narrow for the true score
+        if (score >= beta) {
+            break;
+        }
     }
+    int flag = EXACT;
+    if (max <= original_alpha) {
+        flag = ALPHA;
+    } else if (max >= beta) {
+        flag = BETA;
+    }
+    update_hash_table(hash, max, depth, flag, best_move, 0);
     *best_score = max;
     return best_move;
 }
 
+// Find best move via alphaBeta
+int findBestMove(game_state *gs, int depth, int *best_score,
+                 search_info *info) {
+    if (nnue_enabled) {
+        nnue_refresh(gs);
+    }
+    return searchRoot(gs, depth, -INF, INF, best_score, info);
+}
+
+/*
+
+For tuning the evaluation (see tune.c) we want positions where evaluate() can
+be taken at its word, ones quiescence would stand pat in. So from any position
+we play out the line quiescence expects: at each step, the capture (or check
+evasion) whose full-window score is the position's, until the static
+evaluation is the score. If no move matches (the line was cut short by a
+pruning margin, say), we stop where we are.
+
+*/
+int resolve_quiet(game_state *gs, search_info *info) {
+    moves move_list;
+    undo_info undo;
+    int score = quiescence(gs, -INF, INF, 0, info);
+    int initial_score = score;
+    for (int ply = 0; ply < MAX_PLY - 1; ply++) {
+        int in_check = inCheck(gs);
+        if (!in_check && (evaluate(gs) == score)) {
+            break;
+        }
+        if (in_check) {
+            generateLegalMoves(&move_list, gs);
+        } else {
+            generateCaptures(&move_list, gs);
+        }
+        int found = 0;
+        for (int i = 0; (i < move_list.count) && !found; i++) {
+            makeMove(move_list.moves[i], gs, &undo);
+            if (-quiescence(gs, -INF, INF, 1, info) == score) {
+                found = 1;
+            } else {
+                unmakeMove(move_list.moves[i], gs, &undo);
+            }
+        }
+        if (!found) {
+            break;
+        }
+        score = -score;
+    }
+    return initial_score;
+}
+
+/*
+
+Aspiration windows: the score rarely moves much from one iteration to the
+next, so rather than the full window each iteration searches a narrow one
+around the last score, which prunes far more. If the score falls outside it,
+the window is widened on that side and the iteration searched again.
+
+*/
+#define ASPIRATION_DEPTH 4
+#define ASPIRATION_WINDOW 50
+#define ASPIRATION_MAX 1000
+
+// Searches one iteration, to depth, starting from a narrow window around the
+// last iteration's score (*score) where it makes sense
+static int searchIteration(game_state *gs, int depth, int *score,
+                           search_info *info) {
+    // Shallow iterations and mates are searched with the full window
+    int delta = ASPIRATION_WINDOW;
+    int alpha = -INF;
+    int beta = INF;
+    if (depth >= ASPIRATION_DEPTH && *score > -MATE_BOUND &&
+        *score < MATE_BOUND) {
+        alpha = *score - delta;
+        beta = *score + delta;
+    }
+    while (1) {
+        int best_move = searchRoot(gs, depth, alpha, beta, score, info);
+        if (info->stopped || (*score > alpha && *score < beta)) {
+            return best_move;
+        }
+        // Widen the side which failed, until it's as good as no window
+        info->aspiration_researches++;
+        delta *= 2;
+        if (*score <= alpha) {
+            alpha = (delta > ASPIRATION_MAX) ? -INF : *score - delta;
+        } else {
+            beta = (delta > ASPIRATION_MAX) ? INF : *score + delta;
+        }
+    }
+}
+
+/*
+
+Lazy SMP: to use more than one core, helper threads search the same position
+at the same time as the main one, each with its own copy of the position and
+its own killers and history, and all sharing the hash table. There is no
+splitting of work between them at all: a thread simply finds many positions
+already searched by the others, and as their move ordering differs (and half
+of the helpers search one ply deeper), they explore different parts of the
+tree first. The main thread alone keeps time and reports, and once it is done
+it tells the helpers to stop.
+
+*/
+typedef struct search_thread_t {
+    game_state gs;     // This thread's own copy of the position
+    search_info info;  // ...and its own statistics and ordering
+    int id;
+} search_thread;
+
+static int search_threads = 1;
+static search_thread helpers[MAX_THREADS - 1];
+
+// Sets the number of threads searching, the main one included
+void set_search_threads(int threads) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+    search_threads = threads;
+}
+
+static void *helperSearch(void *arg) {
+    search_thread *thread = (search_thread *)arg;
+    int score = 0;
+    for (int depth = 1 + thread->id % 2; depth < MAX_PLY; depth++) {
+        searchIteration(&thread->gs, depth, &score, &thread->info);
+        if (thread->info.stopped) {
+            break;
+        }
+        thread->info.depth = depth;
+        memcpy(thread->info.pv_line, thread->info.pv[0],
+               sizeof(thread->info.pv_line));
+        thread->info.pv_line_length = thread->info.pv_length[0];
+    }
+    return NULL;
+}
+
+// Nodes searched by the helpers so far (they're still running, so the counts
+// are only approximate)
+static U64 helperNodes() {
+    U64 nodes = 0;
+    for (int t = 0; t < search_threads - 1; t++) {
+        nodes += helpers[t].info.nodes + helpers[t].info.qnodes;
+    }
+    return nodes;
+}
+
+/*
+
+Time management: given the time left on the clock, we aim to spend an equal
+share of it on each of the moves left until the next time control (guessing
+TIME_MOVES_LEFT in sudden death), plus most of the increment. That target is
+the soft limit, past which no new iteration is started, since one which can't
+finish is wasted. The hard limit, a few times further, stops the search part
+way, so that a deep iteration can't overrun wildly; both leave a little time
+for the GUI's own overhead. A fixed time per move (UCI's movetime) leaves the
+same overhead, so the move arrives within the time given.
+
+The soft limit is then adjusted by how settled the search is: if the best move
+has stayed the same for a few iterations, another one is unlikely to change it
+and we stop early, but if it has just changed we give it more time to make
+sure.
+
+*/
+#define TIME_MOVES_LEFT 30
+#define TIME_HARD_FACTOR 4
+#define MOVE_OVERHEAD_MS 30
+#define STABLE_ITERATIONS 3
+
+void fixed_time_limits(search_limits *limits, int turn_time_ms) {
+    limits->soft_ms = turn_time_ms;
+    limits->hard_ms = turn_time_ms;
+    limits->depth = 0;
+    limits->nodes = 0;
+}
+
+void move_time_limits(search_limits *limits, int move_time_ms) {
+    int available = move_time_ms - MOVE_OVERHEAD_MS;
+    fixed_time_limits(limits, available < 1 ? 1 : available);
+}
+
+void fixed_depth_limits(search_limits *limits, int depth, U64 nodes) {
+    limits->soft_ms = -1;
+    limits->hard_ms = -1;
+    limits->depth = depth;
+    limits->nodes = nodes;
+}
+
+void clock_time_limits(search_limits *limits, int time_left_ms,
+                       int increment_ms, int moves_to_go) {
+    int available = time_left_ms - MOVE_OVERHEAD_MS;
+    if (available < 1) {
+        available = 1;
+    }
+    int moves_left = (moves_to_go > 0) ? moves_to_go : TIME_MOVES_LEFT;
+    if (moves_left > TIME_MOVES_LEFT) {
+        moves_left = TIME_MOVES_LEFT;
+    }
+    int soft = available / moves_left + increment_ms * 3 / 4;
+    int hard = soft * TIME_HARD_FACTOR;
+    // Never more than most of what's left
+    if (hard > available * 3 / 4) {
+        hard = available * 3 / 4;
+    }
+    if (soft > hard) {
+        soft = hard;
+    }
+    limits->soft_ms = soft;
+    limits->hard_ms = hard;
+    limits->depth = 0;
+    limits->nodes = 0;
+}
+
+// Whether to start another iteration: within the depth and node limits, and
+// before the soft time limit (scaled by percent, for stability, unless the
+// time is fixed)
+static int searchAnotherIteration(search_limits *limits, int ply,
+                                  search_info *info, int percent) {
+    if (limits->depth && (ply > limits->depth)) {
+        return 0;
+    }
+    if (limits->nodes && (info->nodes + info->qnodes >= limits->nodes)) {
+        return 0;
+    }
+    if ((limits->soft_ms < 0) || __atomic_load_n(&pondering, __ATOMIC_RELAXED)) {
+        return 1;
+    }
+    int elapsed =
+        get_time_ms() - __atomic_load_n(&search_start_ms, __ATOMIC_RELAXED);
+    if (limits->soft_ms == limits->hard_ms) {
+        percent = 100;
+    }
+    return elapsed < limits->soft_ms * percent / 100;
+}
+
 // Iteratively deepens: moves 1 ply at a time, finding the best move at each
 // step. Useful for two cases: first, it early returns if mate is found, meaning
-// we select the fastest mate, and secondly, it ensures a move is found in a
-// given amount of time, even if the search hasn't finished
-int iterativelyDeepen(game_state *gs, int mg_table[12][64],
-                      int eg_table[12][64], int turn_time_ms) {
+// we select the fastest mate, and secondly, it ensures a move is found within
+// the limits, even if the search hasn't finished
+// The statistics for the whole search are left in *info, and after each
+// iteration they are handed to report (if given), e.g. to print UCI info lines
+int iterativelyDeepen(game_state *gs, search_limits *limits,
+                      search_info *info, void (*report)(search_info *info)) {
     int ply = 1;
     int start_time = get_time_ms();
-    int score;
+    int score = 0;
     // Requires that at least one move is found at 1 ply
     int best_move = 0;
-    while (1) {
+    // Iterations in a row which found the same best move, and how much of
+    // the soft time limit that lets us use
+    int stable = 0;
+    int percent = 100;
+    clear_search_info(info);
+    info->limits = limits;
+    age_hash_table();
+    __atomic_store_n(&search_start_ms, start_time, __ATOMIC_RELAXED);
+    // The network may have been switched on since the position was set up,
+    // leaving its accumulators out of date
+    if (nnue_enabled) {
+        nnue_refresh(gs);
+    }
+    // If the tablebases hold the root, their move needs no search (nor do the
+    // helpers)
+    int tb_move = syzygy_probe_root(gs, &score);
+    int helper_count = (tb_move == NULLMOVE) ? search_threads - 1 : 0;
+    if (tb_move != NULLMOVE) {
+        best_move = tb_move;
+        info->depth = 1;
+        info->score = score;
+        info->best_move = best_move;
+        info->pv_line[0] = best_move;
+        info->pv_line_length = 1;
+        info->tb_hits = 1;
+        info->elapsed_ms = get_time_ms() - start_time;
+        if (report) {
+            report(info);
+        }
+    }
+    // Start the helpers
+    pthread_t handles[MAX_THREADS - 1];
+    __atomic_store_n(&helpers_stop, 0, __ATOMIC_RELAXED);
+    for (int t = 0; t < helper_count; t++) {
+        helpers[t].gs = *gs;
+        helpers[t].id = t + 1;
+        clear_search_info(&helpers[t].info);
+        pthread_create(&handles[t], NULL, helperSearch, &helpers[t]);
+    }
+    while ((tb_move == NULLMOVE) && (ply < MAX_PLY)) {
         int curr_time = get_time_ms();
-        // Early return for out of time
-        if (curr_time - start_time > turn_time_ms) {
+        // Early return for out of time (or depth, or nodes)
+        if ((ply > 1) && !searchAnotherIteration(limits, ply, info, percent)) {
+            break;
+        }
+        int iteration_score = score;
+        int iteration_move = searchIteration(gs, ply, &iteration_score, info);
+        // An unfinished iteration's move can't be trusted
+        if (info->stopped) {
             break;
         }
-        best_move = findBestMove(gs, mg_table, eg_table, ply, &score);
+        if ((ply > 1) && (iteration_move == best_move)) {
+            stable++;
+        } else {
+            stable = 0;
+        }
+        if (stable >= STABLE_ITERATIONS) {
+            percent = 50;
+        } else if ((ply > 1) && (stable == 0)) {
+            percent = 150;
+        } else {
+            percent = 100;
+        }
+        best_move = iteration_move;
+        score = iteration_score;
+        info->depth = ply;
+        info->score = score;
+        info->best_move = best_move;
+        memcpy(info->pv_line, info->pv[0], sizeof(info->pv_line));
+        info->pv_line_length = info->pv_length[0];
+        info->elapsed_ms = get_time_ms() - start_time;
+        info->iteration_ms = get_time_ms() - curr_time;
+        info->helper_nodes = helperNodes();
+        if (report) {
+            report(info);
+        }
         // Deepen for next search
         ++ply;
         // Early return for checkmate
-        if (score >= 9999999) {
-            return best_move;
+        if ((score >= MATE_BOUND) || (score <= -MATE_BOUND)) {
+            break;
         }
     }
-    printf("Looked %i moves ahead\n", ply);
+    // A ponder (or infinite) search mustn't end by itself, even if there's
+    // nothing left to search
+    while (__atomic_load_n(&pondering, __ATOMIC_RELAXED) &&
+           !__atomic_load_n(&stop_requested, __ATOMIC_RELAXED)) {
+        sleep_ms(1);
+    }
+    // Stop the helpers
+    __atomic_store_n(&helpers_stop, 1, __ATOMIC_RELAXED);
+    for (int t = 0; t < helper_count; t++) {
+        pthread_join(handles[t], NULL);
+    }
+    info->helper_nodes = helper_count ? helperNodes() : 0;
     return best_move;
 }
 
+// Iteratively deepens within the depth and node limits on the calling thread
+// alone: no time limit, helpers or root tablebase probe, and nothing shared
+// but the hash table, so that many such searches can run at once (see
+// analyze.c and selfplay.c). The search uses params (the defaults if NULL),
+// and its results are left in *info, as iterativelyDeepen leaves them
+int search_to_depth(game_state *gs, search_limits *limits,
+                    const search_params *params, search_info *info) {
+    int start_time = get_time_ms();
+    int score = 0;
+    clear_search_info(info);
+    info->limits = limits;
+    if (params) {
+        info->params = params;
+    }
+    if (nnue_enabled) {
+        nnue_refresh(gs);
+    }
+    int depth = limits->depth ? limits->depth : MAX_PLY - 1;
+    for (int ply = 1; (ply <= depth) && (ply < MAX_PLY); ply++) {
+        int best_move = searchIteration(gs, ply, &score, info);
+        // An unfinished iteration's move can't be trusted
+        if (info->stopped) {
+            break;
+        }
+        info->depth = ply;
+        info->score = score;
+        info->best_move = best_move;
+        memcpy(info->pv_line, info->pv[0], sizeof(info->pv_line));
+        info->pv_line_length = info->pv_length[0];
+        if ((score >= MATE_BOUND) || (score <= -MATE_BOUND)) {
+            break;
+        }
+    }
+    info->elapsed_ms = get_time_ms() - start_time;
+    return info->best_move;
+}
+
 // Finds best move and returns a long-algebraic string version
-void computerMakeMove(char output[5], game_state *gs, int mg_table[12][64],
-                      int eg_table[12][64], int depth) {
+void computerMakeMove(char output[5], game_state *gs, int depth) {
     int score;
-    int best_move = findBestMove(gs, mg_table, eg_table, depth, &score);
+    search_info info;
+    clear_search_info(&info);
+    int best_move = findBestMove(gs, depth, &score, &info);
     square source_sq = decodeSource(best_move);
     square dest_sq = decodeDest(best_move);
     piece promoteTo = decodePromote(best_move);
@@ -254,20 +1253,24 @@ void db_simple_pos() {
     // Set up game
     // Init game memory
     game_state *gs = MALLOC(1, game_state);
-    // Set up board
-    parse_fen(gs, "k7/8/8/5p2/4P3/6K1/8/8 w - - 0 1");
     // Set up magic bitboards
     init_magic_bitboards();
+    // Set up non-sliding attack tables
+    init_attack_tables();
     // Set up piece-square tables
-    int mg_table[12][64];
-    int eg_table[12][64];
-    init_tables(mg_table, eg_table);
-    // Set up hash tables
+    init_tables();
+    // Set up search reductions
+    init_search();
+    // Set up hash tables (before the board, which needs the hash codes)
     init_zobrist_tables();
     init_hash_table();
+    // Set up board
+    parse_fen(gs, "k7/8/8/5p2/4P3/6K1/8/8 w - - 0 1");
     // Search 1 deep
     int score;
-    int best_move = findBestMove(gs, mg_table, eg_table, 1, &score);
+    search_info info;
+    clear_search_info(&info);
+    int best_move = findBestMove(gs, 1, &score, &info);
     char output[5];
     square source_sq = decodeSource(best_move);
     square dest_sq = decodeDest(best_move);
@@ -286,20 +1289,24 @@ void db_fork_pos() {
     // Set up game
     // Init game memory
     game_state *gs = MALLOC(1, game_state);
-    // Set up board
-    parse_fen(gs, "8/8/1k3r2/8/8/4N1K1/8/8 w - - 0 1");
     // Set up magic bitboards
     init_magic_bitboards();
+    // Set up non-sliding attack tables
+    init_attack_tables();
     // Set up piece-square tables
-    int mg_table[12][64];
-    int eg_table[12][64];
-    init_tables(mg_table, eg_table);
-    // Set up hash tables
+    init_tables();
+    // Set up search reductions
+    init_search();
+    // Set up hash tables (before the board, which needs the hash codes)
     init_zobrist_tables();
     init_hash_table();
+    // Set up board
+    parse_fen(gs, "8/8/1k3r2/8/8/4N1K1/8/8 w - - 0 1");
     // Search 1 deep
     int score;
-    int best_move = findBestMove(gs, mg_table, eg_table, 3, &score);
+    search_info info;
+    clear_search_info(&info);
+    int best_move = findBestMove(gs, 3, &score, &info);
     char output[5];
     square source_sq = decodeSource(best_move);
     square dest_sq = decodeDest(best_move);
@@ -310,4 +1317,4 @@ void db_fork_pos() {
         strcpy(output + 4, pieceStringMap[promoteTo]);
     }
     printf("Found the best move to be %s, with score %i\n", output, score);
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,404 @@
+#include "chess.h"
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+  _______________________________________
+ /                                       \
+/   _   _   _                 _   _   _   \
+|  | |_| |_| |   _   _   _   | |_| |_| |  |
+|   \   _   /   | |_| |_| |   \   _   /   |
+|    | | | |     \       /     | | | |    |
+|    | |_| |______|     |______| |_| |    |
+|    |              ___              |    |
+|    |  _    _    (     )    _    _  |    |
+|    | | |  |_|  (       )  |_|  | | |    |
+|    | |_|       |       |       |_| |    |
+|   /            |_______|            \   |
+|  |___________________________________|  |
+\             Computer Chess              /
+ \_______________________________________/
+
+===========================================
+-------------------------------------------
+                SELF-PLAY
+-------------------------------------------
+===========================================
+
+The bench says whether a change made the engine faster, but not whether it
+made it stronger: only games can. Self-play plays two configurations of the
+engine against each other, the base and the test, many games at once inside
+one process (./aldan --selfplay, or make selfplay):
+
+./aldan --selfplay <openings> <base> <test> [--games N] [--threads T]
+        [--nodes N] [--depth D] [--hash MB] [--nnue file]
+        [--elo0 E] [--elo1 E] [--alpha A] [--beta B]
+
+A configuration is a set of search_params (see search.c), written as "default"
+or as changes to the defaults, e.g. "lmr=0" or "futility_margin=100,
+null_move_reduction=3". Two builds can't share a process, but the search's
+compile-time switches are the defaults of these, so the same comparison can be
+made without rebuilding.
+
+Each opening (a position from an EPD file, see parse_epd) is played twice,
+each side taking each color once. Every move is searched to a node count (or
+depth), never a time, so that games played side by side on busy cores are
+still fair. The threads play one game each at a time and share the hash
+table, as the Lazy SMP helpers do; the test's keys are XORed with a constant,
+so that neither side finds the other's entries. A game ends as checkGameover
+would end it (see game_result), or as a draw by the 50 move rule, threefold
+repetition, or after SELFPLAY_MAX_PLIES plies.
+
+The games stop early when a sequential probability ratio test decides: H0 is
+that the test is elo0 stronger than the base, H1 that it is elo1 stronger, and
+after each game the log-likelihood ratio of the wins, draws and losses so far
+(under the usual normal approximation) is checked against the bounds set by
+the error rates alpha and beta. Once it passes one, no new games are started.
+The approximation needs a variance worth the name, so nothing is decided in the
+first SPRT_MIN_GAMES games.
+
+*/
+
+#define SELFPLAY_GAMES 20000
+#define SELFPLAY_NODES 10000
+#define SELFPLAY_MAX_PLIES 400
+#define SELFPLAY_REPORT 100
+#define SPRT_MIN_GAMES 50
+// Kept apart in the hash table from the base's keys
+#define TEST_HASH_SALT 0x9E3779B97F4A7C15ULL
+
+typedef struct engineConfig_t {
+    const char *name;     // As given on the command line
+    search_params params; // The searches' parameters
+    U64 salt;             // XORed into the keys of the positions it searches
+} engine_config;
+
+typedef struct selfplayMatch_t {
+    game_state *openings; // Starting positions, each played twice
+    int opening_count;
+    engine_config engines[2]; // The base and the test
+    search_limits limits;     // For every move of either side
+    int games;                // Most games to play
+    int next_game;            // Next game to start, shared by all threads
+    int stopped;              // Set once the SPRT has decided
+    // Results for the test (only changed under result_lock)
+    int wins;
+    int draws;
+    int losses;
+    double elo0, elo1;
+    double lower, upper; // The SPRT's bounds on the log-likelihood ratio
+} selfplay_match;
+
+static pthread_mutex_t result_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The parameters a configuration can change, by name
+static const struct {
+    const char *name;
+    size_t offset;
+} param_names[] = {
+    {"null_move", offsetof(search_params, null_move)},
+    {"null_move_reduction", offsetof(search_params, null_move_reduction)},
+    {"lmr", offsetof(search_params, lmr)},
+    {"futility", offsetof(search_params, futility)},
+    {"futility_margin", offsetof(search_params, futility_margin)},
+};
+#define PARAM_COUNT (int)(sizeof(param_names) / sizeof(param_names[0]))
+
+// Reads a configuration, e.g. "lmr=0,futility_margin=100", returning nonzero
+// if it has a parameter we don't know
+static int parseConfig(const char *text, engine_config *engine) {
+    engine->name = text;
+    engine->params = default_search_params;
+    if (!strcmp(text, "default")) {
+        return 0;
+    }
+    while (*text) {
+        char name[32];
+        int value;
+        int length;
+        if (sscanf(text, "%31[^=,]=%d%n", name, &value, &length) != 2) {
+            printf("Could not read %s\n", text);
+            return 1;
+        }
+        int found = 0;
+        for (int i = 0; i < PARAM_COUNT; i++) {
+            if (!strcmp(name, param_names[i].name)) {
+                *(int *)((char *)&engine->params + param_names[i].offset) =
+                    value;
+                found = 1;
+            }
+        }
+        if (!found) {
+            printf("Unknown search parameter %s\n", name);
+            return 1;
+        }
+        text += length;
+        text += strspn(text, ", ");
+    }
+    return 0;
+}
+
+// Reads the legal positions of an EPD file, returning how many there are (or
+// -1 if the file can't be opened)
+static int readOpenings(char *openings_file, game_state **openings) {
+    FILE *input = fopen(openings_file, "r");
+    if (!input) {
+        printf("Could not open %s\n", openings_file);
+        return -1;
+    }
+    char line[EPD_LINE];
+    moves move_list;
+    int count = 0;
+    int size = 0;
+    *openings = NULL;
+    while (fgets(line, EPD_LINE, input)) {
+        if (count == size) {
+            size = size ? 2 * size : 64;
+            *openings = realloc(*openings, size * sizeof(game_state));
+        }
+        // Only positions with a game left to play
+        game_state *gs = &(*openings)[count];
+        if ((line[0] != '#') && parse_epd(gs, line) && position_is_legal(gs) &&
+            (game_result(&move_list, gs) == GAME_ONGOING)) {
+            count++;
+        }
+    }
+    fclose(input);
+    return count;
+}
+
+// Whether the position has been seen twice before with the same side to move
+// (and nothing irreversible since)
+static int isThreefold(U64 keys[], int ply, int halfmove_counter) {
+    int seen = 0;
+    for (int i = ply - 4; (i >= 0) && (i >= ply - halfmove_counter); i -= 2) {
+        if (keys[i] == keys[ply]) {
+            seen++;
+        }
+    }
+    return seen >= 2;
+}
+
+// Plays one game, returning its result for the test (0 = loss, 1 = draw,
+// 2 = win)
+static int playGame(selfplay_match *match, int game, search_info *info) {
+    game_state gs = match->openings[(game / 2) % match->opening_count];
+    // The test plays white in even games, black in odd ones
+    int test_color = (game % 2) ? BLACK : WHITE;
+    U64 keys[SELFPLAY_MAX_PLIES + 1];
+    moves move_list;
+    keys[0] = gs.hash;
+    // A new game: the deep entries left by finished ones give way to its own
+    age_hash_table();
+    for (int ply = 0; ply < SELFPLAY_MAX_PLIES; ply++) {
+        int result = game_result(&move_list, &gs);
+        if (result == GAME_CHECKMATE) {
+            return (gs.whose_turn == test_color) ? 0 : 2;
+        }
+        if ((result != GAME_ONGOING) || (gs.halfmove_counter >= 100) ||
+            isThreefold(keys, ply, gs.halfmove_counter)) {
+            return 1;
+        }
+        engine_config *engine = &match->engines[gs.whose_turn == test_color];
+        game_state search_gs = gs;
+        search_gs.hash ^= engine->salt;
+        int move =
+            search_to_depth(&search_gs, &match->limits, &engine->params, info);
+        makeMove(move, &gs, NULL);
+        keys[ply + 1] = gs.hash;
+    }
+    return 1;
+}
+
+static double eloToScore(double elo) {
+    return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+}
+
+static double scoreToElo(double score) {
+    return -400.0 * log10(1.0 / score - 1.0);
+}
+
+// The mean and variance of the test's score per game so far, returning the
+// number of games
+static int scoreStats(selfplay_match *match, double *score, double *variance) {
+    int games = match->wins + match->draws + match->losses;
+    if (!games) {
+        *score = 0.5;
+        *variance = 0;
+        return 0;
+    }
+    *score = (match->wins + match->draws / 2.0) / games;
+    *variance = (match->wins * (1 - *score) * (1 - *score) +
+                 match->draws * (0.5 - *score) * (0.5 - *score) +
+                 match->losses * *score * *score) /
+                games;
+    return games;
+}
+
+// The SPRT's log-likelihood ratio for the results so far
+static double logLikelihoodRatio(selfplay_match *match) {
+    double score, variance;
+    int games = scoreStats(match, &score, &variance);
+    if (variance <= 0) {
+        return 0;
+    }
+    double s0 = eloToScore(match->elo0);
+    double s1 = eloToScore(match->elo1);
+    return (s1 - s0) * (2 * score - s0 - s1) * games / (2 * variance);
+}
+
+// Prints the results so far, with the Elo difference and its 95% interval
+static void printResults(selfplay_match *match, double llr) {
+    double score, variance;
+    int games = scoreStats(match, &score, &variance);
+    double margin = 1.96 * sqrt(variance / games);
+    // Clamped away from 0 and 1, where the Elo difference is infinite
+    double low = fmax(score - margin, 0.001);
+    double high = fmin(score + margin, 0.999);
+    double mid = fmin(fmax(score, 0.001), 0.999);
+    printf("Games %i\t:\t+%i =%i -%i\t:\tElo %.1f [%.1f, %.1f]\t:\tLLR %.2f "
+           "[%.2f, %.2f]\n",
+           games, match->wins, match->draws, match->losses, scoreToElo(mid),
+           scoreToElo(low), scoreToElo(high), llr, match->lower, match->upper);
+    fflush(stdout);
+}
+
+static void *selfplayWorker(void *arg) {
+    selfplay_match *match = (selfplay_match *)arg;
+    search_info *info = MALLOC(1, search_info);
+    int game;
+    while (!__atomic_load_n(&match->stopped, __ATOMIC_RELAXED) &&
+           ((game = __atomic_fetch_add(&match->next_game, 1,
+                                       __ATOMIC_RELAXED)) < match->games)) {
+        int result = playGame(match, game, info);
+        pthread_mutex_lock(&result_lock);
+        if (result == 2) {
+            match->wins++;
+        } else if (result == 1) {
+            match->draws++;
+        } else {
+            match->losses++;
+        }
+        double llr = logLikelihoodRatio(match);
+        int games = match->wins + match->draws + match->losses;
+        if (games % SELFPLAY_REPORT == 0) {
+            printResults(match, llr);
+        }
+        // Games under way are still finished, and counted
+        if ((games >= SPRT_MIN_GAMES) &&
+            ((llr <= match->lower) || (llr >= match->upper))) {
+            __atomic_store_n(&match->stopped, 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&result_lock);
+    }
+    free(info);
+    return NULL;
+}
+
+int selfplay(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("Usage: --selfplay <openings> <base> <test> [options]\n");
+        return -1;
+    }
+    selfplay_match match;
+    memset(&match, 0, sizeof(match));
+    if (parseConfig(argv[1], &match.engines[0]) ||
+        parseConfig(argv[2], &match.engines[1])) {
+        return -1;
+    }
+    match.engines[1].salt = TEST_HASH_SALT;
+    match.games = SELFPLAY_GAMES;
+    match.elo0 = 0;
+    match.elo1 = 5;
+    int threads = 1;
+    int depth = 0;
+    U64 nodes = SELFPLAY_NODES;
+    double alpha = 0.05;
+    double beta = 0.05;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--games")) {
+            match.games = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--threads")) {
+            threads = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--nodes")) {
+            nodes = strtoull(argv[i + 1], NULL, 10);
+        } else if (!strcmp(argv[i], "--depth")) {
+            depth = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--hash")) {
+            resize_hash_table(atoi(argv[i + 1]));
+        } else if (!strcmp(argv[i], "--nnue")) {
+            if (nnue_load(argv[i + 1])) {
+                printf("Could not load %s\n", argv[i + 1]);
+                return -1;
+            }
+            nnue_set_enabled(1);
+        } else if (!strcmp(argv[i], "--elo0")) {
+            match.elo0 = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--elo1")) {
+            match.elo1 = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--alpha")) {
+            alpha = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--beta")) {
+            beta = atof(argv[i + 1]);
+        }
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+    if (depth >= MAX_PLY) {
+        depth = MAX_PLY - 1;
+    }
+    // A depth alone limits the search; otherwise the nodes do
+    fixed_depth_limits(&match.limits, depth, depth ? 0 : nodes);
+    match.lower = log(beta / (1 - alpha));
+    match.upper = log((1 - beta) / alpha);
+    match.opening_count = readOpenings(argv[0], &match.openings);
+    if (match.opening_count <= 0) {
+        if (!match.opening_count) {
+            printf("No legal positions in %s\n", argv[0]);
+        }
+        free(match.openings);
+        return -1;
+    }
+    printf("Base %s against test %s, %i openings, %i threads\n",
+           match.engines[0].name, match.engines[1].name, match.opening_count,
+           threads);
+    printf("SPRT: elo0 %.1f, elo1 %.1f, alpha %.3f, beta %.3f\n", match.elo0,
+           match.elo1, alpha, beta);
+    fflush(stdout);
+    int start_ms = get_time_ms();
+    pthread_t *handles = MALLOC(threads, pthread_t);
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&handles[t], NULL, selfplayWorker, &match);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(handles[t], NULL);
+    }
+    free(handles);
+    free(match.openings);
+    double llr = logLikelihoodRatio(&match);
+    int games = match.wins + match.draws + match.losses;
+    if (games % SELFPLAY_REPORT) {
+        printResults(&match, llr);
+    }
+    if (games < SPRT_MIN_GAMES) {
+        printf("No decision after only %i games\n", games);
+    } else if (llr >= match.upper) {
+        printf("H1 accepted: %s is stronger than %s\n", match.engines[1].name,
+               match.engines[0].name);
+    } else if (llr <= match.lower) {
+        printf("H0 accepted: %s isn't stronger than %s\n",
+               match.engines[1].name, match.engines[0].name);
+    } else {
+        printf("No decision after %i games\n", games);
+    }
+    printf("Played %i games in %i ms\n", games, get_time_ms() - start_ms);
+    return games;
+}
@@ -0,0 +1,167 @@
+#include "chess.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if USE_SYZYGY
+#include "tbprobe.h"
+#endif
+
+/*
+  _______________________________________
+ /                                       \
+/   _   _   _                 _   _   _   \
+|  | |_| |_| |   _   _   _   | |_| |_| |  |
+|   \   _   /   | |_| |_| |   \   _   /   |
+|    | | | |     \       /     | | | |    |
+|    | |_| |______|     |______| |_| |    |
+|    |              ___              |    |
+|    |  _    _    (     )    _    _  |    |
+|    | | |  |_|  (       )  |_|  | | |    |
+|    | |_|       |       |       |_| |    |
+|   /            |_______|            \   |
+|  |___________________________________|  |
+\             Computer Chess              /
+ \_______________________________________/
+
+===========================================
+-------------------------------------------
+            ENDGAME TABLEBASES
+-------------------------------------------
+===========================================
+
+With few enough pieces left, every position has been solved: the Syzygy
+tablebases give the result with perfect play (win, draw or loss, "WDL"), and
+the distance to the next capture or pawn move which keeps it ("DTZ"). The
+search uses them in two places:
+- inside alphaBeta, once few enough pieces are left, the WDL tables give a
+  node's score outright (a win scores TB_WIN less the ply, below any mate)
+- at the root, the DTZ tables give the move itself, which needs no search
+
+Probing is done by Fathom (https://github.com/jdart1/Fathom), which maps the
+table files into memory. It isn't part of this repository: to build with it,
+copy its src directory to fathom/ and build with make SYZYGY=1 (see the
+Makefile). Without it, there are no tables, and every probe fails.
+
+Fathom's probes can't say anything about positions which still have castling
+rights, and its WDL probe only answers right after a capture or pawn move (as
+the 50 move rule could otherwise change the result), so those are left to the
+search.
+
+*/
+
+int syzygy_pieces = 0;
+
+#if USE_SYZYGY
+// Fathom numbers squares from a1 along each rank, and we from h1, so each rank
+// of a bitboard is reversed
+static U64 toFathom(U64 bb) {
+    bb = ((bb >> 1) & 0x5555555555555555ULL) |
+         ((bb & 0x5555555555555555ULL) << 1);
+    bb = ((bb >> 2) & 0x3333333333333333ULL) |
+         ((bb & 0x3333333333333333ULL) << 2);
+    bb = ((bb >> 4) & 0x0F0F0F0F0F0F0F0FULL) |
+         ((bb & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return bb;
+}
+
+// The same for a single square (which works both ways)
+static square fathomSquare(unsigned sq) { return 8 * (sq / 8) + 7 - sq % 8; }
+
+// The pieces of both colors of a kind
+#define BOTH(gs, piec) ((gs)->piece_bb[2 * (piec)] | (gs)->piece_bb[2 * (piec) + 1])
+
+// Score of a WDL result for the side to move, ply plies from the root
+static int wdlScore(unsigned wdl, int ply) {
+    if (wdl == TB_WIN) {
+        return TB_WIN_SCORE - ply;
+    }
+    if (wdl == TB_LOSS) {
+        return -TB_WIN_SCORE + ply;
+    }
+    // Draws, including wins and losses the 50 move rule turns into draws
+    return 0;
+}
+#endif
+
+int syzygy_init(const char *path) {
+#if USE_SYZYGY
+    // Fathom takes an empty path as no tables
+    if (!strcmp(path, "<empty>")) {
+        path = "";
+    }
+    syzygy_pieces = 0;
+    if (!tb_init(path)) {
+        return -1;
+    }
+    syzygy_pieces = TB_LARGEST;
+    return syzygy_pieces;
+#else
+    (void)path;
+    return -1;
+#endif
+}
+
+int syzygy_probe_wdl(game_state *gs, int ply, int *score) {
+#if USE_SYZYGY
+    if (gs->castling || gs->halfmove_counter) {
+        return 0;
+    }
+    unsigned ep = gs->en_passant ? fathomSquare(bbToSq(gs->en_passant)) : 0;
+    unsigned wdl = tb_probe_wdl(
+        toFathom(gs->color_bb[WHITE]), toFathom(gs->color_bb[BLACK]),
+        toFathom(BOTH(gs, king)), toFathom(BOTH(gs, queen)),
+        toFathom(BOTH(gs, rook)), toFathom(BOTH(gs, bishop)),
+        toFathom(BOTH(gs, knight)), toFathom(BOTH(gs, pawn)), 0, 0, ep,
+        gs->whose_turn == WHITE);
+    if (wdl == TB_RESULT_FAILED) {
+        return 0;
+    }
+    *score = wdlScore(wdl, ply);
+    return 1;
+#else
+    (void)gs;
+    (void)ply;
+    (void)score;
+    return 0;
+#endif
+}
+
+int syzygy_probe_root(game_state *gs, int *score) {
+#if USE_SYZYGY
+    if (!syzygy_pieces || gs->castling ||
+        (__builtin_popcountll(gs->all_bb) > syzygy_pieces)) {
+        return NULLMOVE;
+    }
+    unsigned ep = gs->en_passant ? fathomSquare(bbToSq(gs->en_passant)) : 0;
+    unsigned result = tb_probe_root(
+        toFathom(gs->color_bb[WHITE]), toFathom(gs->color_bb[BLACK]),
+        toFathom(BOTH(gs, king)), toFathom(BOTH(gs, queen)),
+        toFathom(BOTH(gs, rook)), toFathom(BOTH(gs, bishop)),
+        toFathom(BOTH(gs, knight)), toFathom(BOTH(gs, pawn)),
+        gs->halfmove_counter, 0, ep, gs->whose_turn == WHITE, NULL);
+    if ((result == TB_RESULT_FAILED) || (result == TB_RESULT_CHECKMATE) ||
+        (result == TB_RESULT_STALEMATE)) {
+        return NULLMOVE;
+    }
+    square source = fathomSquare(TB_GET_FROM(result));
+    square dest = fathomSquare(TB_GET_TO(result));
+    // Fathom's promotions run from the queen (1) down to the knight (4)
+    unsigned promotes = TB_GET_PROMOTES(result);
+    piece promote_to = promotes ? (piece)(queen + 1 - promotes) : pawn;
+    moves move_list;
+    generateLegalMoves(&move_list, gs);
+    for (int i = 0; i < move_list.count; i++) {
+        int move = move_list.moves[i];
+        if ((decodeSource(move) == source) && (decodeDest(move) == dest) &&
+            (decodePromote(move) == promote_to)) {
+            *score = wdlScore(TB_GET_WDL(result), 0);
+            return move;
+        }
+    }
+    return NULLMOVE;
+#else
+    (void)gs;
+    (void)score;
+    return NULLMOVE;
+#endif
+}
@@ -1,6 +1,8 @@
 #include "chess.h"
 #include <ctype.h>
+#include <limits.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -58,19 +60,21 @@ Besides, on modern computers memory shouldn't be of enormous as an issue.
 */
 
 // For each colored piece, a code (bitstring) per square
-static U64 pieceCodes[12][64];
+U64 pieceCodes[12][64];
 // For each castling right (in FEN order KQkq)
 #define kingsideWhite 0
 #define queensideWhite 1
 #define kingsideBlack 2
 #define queensideBlack 3
-static U64 castlingCodes[4];
+// For each set of castling rights (indexed by game_state's castling bits),
+// the XOR of the codes of the rights in it
+U64 castlingCodes[16];
 // En passant squares (denoted by file)
-static U64 enpassantCodes[8];
+U64 enpassantCodes[8];
 // Turn switching (xor at every move)
-static U64 endTurnCode;
+U64 endTurnCode;
 
-// Size of hash table (smaller than maximum U64, so need to modulo)
+// Number of table slots debug_tables checks the keys for collisions in
 #define BIGNUMBER 0x400000
 
 // A random bitstring generator, with input (seed) being the previous bitstring
@@ -92,9 +96,19 @@ void init_zobrist_tables() {
         }
     }
     // Init extras
+    U64 rightCodes[4];
     for (int i = 0; i < 4; i++) {
-        castlingCodes[i] = random_bitstring(prev);
-        prev = castlingCodes[i];
+        rightCodes[i] = random_bitstring(prev);
+        prev = rightCodes[i];
+    }
+    // castling is in order KQkq from the highest bit down
+    for (int rights = 0; rights < 16; rights++) {
+        castlingCodes[rights] = 0ULL;
+        for (int i = 0; i < 4; i++) {
+            if (rights & (1 << (3 - i))) {
+                castlingCodes[rights] ^= rightCodes[i];
+            }
+        }
     }
     for (int i = 0; i < 8; i++) {
         enpassantCodes[i] = random_bitstring(prev);
@@ -132,22 +146,39 @@ void debug_tables() {
     }
 }
 
-// Compute the hash for the current position (should avoid doing this except
-// at the start)
+// Compute the hash for the current position from scratch: every piece, plus
+// the "extras" (whose turn it is, castling rights, and the en-passant file).
+// This is only needed when setting up a position (init_board and parse_fen
+// store it in gs->hash), since makeMove keeps gs->hash up to date
 U64 current_pos_hash(game_state *gs) {
     U64 hash = 0ULL;
-    U64 bb;
-    // XOR every square
-    for (square sq = h1; sq <= a8; sq++) {
-        bb = 1ULL << sq;
-        // Only XOR if square is occupied
-        if (bb & gs->all_bb) {
-            // Find piece
-            for (int i = 0; i < 12; i++) {
-                if (bb & gs->piece_bb[i]) {
-                    hash ^= pieceCodes[i][sq];
-                }
-            }
+    // XOR every occupied square, one piece bitboard at a time
+    for (int i = 0; i < 12; i++) {
+        U64 bb = gs->piece_bb[i];
+        while (bb) {
+            hash ^= pieceCodes[i][bbToSq(bb)];
+            bb &= bb - 1;
+        }
+    }
+    if (gs->whose_turn) {
+        hash ^= endTurnCode;
+    }
+    hash ^= castlingCodes[gs->castling];
+    if (gs->en_passant) {
+        hash ^= enpassantCodes[bbToSq(gs->en_passant) % 8];
+    }
+    return hash;
+}
+
+// The same for the pawns alone, which the pawn hash table in eval.c is keyed
+// by (makeMove keeps gs->pawn_hash up to date)
+U64 current_pawn_hash(game_state *gs) {
+    U64 hash = 0ULL;
+    for (int color = WHITE; color <= BLACK; color++) {
+        U64 bb = gs->piece_bb[2 * pawn + color];
+        while (bb) {
+            hash ^= pieceCodes[2 * pawn + color][bbToSq(bb)];
+            bb &= bb - 1;
         }
     }
     return hash;
@@ -163,9 +194,8 @@ U64 start_hash() {
 /* transposition table (tt)
 Contains the following:
 - Hash key
-    Since we must modulo by the number of
-    elements in the array, this allows us to check whether
-    we've collided
+    Since many positions share a slot in the table, this allows us to check
+    whether we've collided
 - Relative depth
 - Evaluation
     This can come in three varieties: the actual "exact" score of a position,
@@ -179,26 +209,127 @@ Contains the following:
 - The best move in a position
     Which allows for quicker searches: we always search the best move in a
     position first
+- The age of the entry
+    The number of the search which stored it, so that entries left over from
+    earlier searches (earlier moves in the game) are the first to be replaced
+
+All but the key are packed into a single U64, so that an entry takes 16 bytes
+and four of them fit in a 64-byte bucket, i.e. one cache line. A position can
+be stored in any entry of its bucket, so one lookup costs a single trip to
+memory but still gives four chances to find the position, and a choice of
+which entry to throw away when storing:
+- an entry for the same position is always replaced
+- otherwise the shallowest entry is, counting entries from earlier searches as
+  shallower the older they are
+
+The number of buckets is a power of two, so the bucket is found by masking the
+low bits of the key rather than by a (slow) modulo, and the size is chosen at
+runtime (the UCI "Hash" option).
+
+Mate scores are stored relative to the position rather than to the root ("mate
+in 3 from here"), since the same position may be reached at different plies.
+
+With several search threads sharing the table, one thread may read an entry
+while another is halfway through writing it, getting the key of one position
+and the data of another. Rather than locking, each entry stores the key XORed
+with the data: a torn entry then fails to match its key, and is treated as a
+miss, just like any other position which isn't in the table.
+
 */
 typedef struct tt_t {
     U64 hash_key;
-    int relativeDepth;
-    int eval;
-    int flag;
-    int bestMove;
+    U64 data;
 } tt;
 
-tt hash_table[BIGNUMBER];
+#define BUCKET_SIZE 4
+typedef struct tt_bucket_t {
+    tt entries[BUCKET_SIZE];
+} tt_bucket;
+
+// Packing the data: move (32 bits), eval (16), depth (8), flag (2), age (6)
+#define TT_EVAL_SHIFT 32
+#define TT_DEPTH_SHIFT 48
+#define TT_FLAG_SHIFT 56
+#define TT_AGE_SHIFT 58
+#define TT_AGES 64
 
-// clear TT (hash table)
+static tt_bucket *hash_table = NULL;
+// The allocation (which is aligned to a cache line by hand)
+static void *hash_memory = NULL;
+static U64 hash_mask = 0;
+// Number of the current search, modulo TT_AGES (read and bumped atomically,
+// since analysis and self-play workers bump it while others are searching)
+static int hash_age = 0;
+
+static int ttMove(U64 data) { return (int)(data & 0xFFFFFFFF); }
+static int ttEval(U64 data) { return (short)((data >> TT_EVAL_SHIFT) & 0xFFFF); }
+static int ttDepth(U64 data) { return (int)((data >> TT_DEPTH_SHIFT) & 0xFF); }
+static int ttFlag(U64 data) { return (int)((data >> TT_FLAG_SHIFT) & 0x3); }
+static int ttAge(U64 data) { return (int)(data >> TT_AGE_SHIFT); }
+
+// (Re)allocates the hash table with the given size in megabytes, rounded down
+// to a power of two number of buckets. The table is left empty
+void resize_hash_table(int megabytes) {
+    free(hash_memory);
+    hash_memory = NULL;
+    hash_table = NULL;
+    hash_mask = 0;
+    if (megabytes < 1) {
+        megabytes = 1;
+    }
+    U64 buckets = 1;
+    while (buckets * 2 * sizeof(tt_bucket) <= (U64)megabytes << 20) {
+        buckets *= 2;
+    }
+    // Try smaller tables if there isn't enough memory
+    while (buckets && !hash_memory) {
+        hash_memory = calloc(buckets * sizeof(tt_bucket) + 63, 1);
+        if (!hash_memory) {
+            buckets /= 2;
+        }
+    }
+    if (!hash_memory) {
+        printf("Could not allocate a hash table\n");
+        exit(1);
+    }
+    hash_table =
+        (tt_bucket *)(((uintptr_t)hash_memory + 63) & ~(uintptr_t)63);
+    hash_mask = buckets - 1;
+}
+
+// clear TT (hash table), allocating it at the default size if it hasn't been
+// yet
 void init_hash_table() {
-    // loop over TT elements
-    for (int index = 0; index < BIGNUMBER; index++) {
-        // reset TT inner fields
-        hash_table[index].hash_key = 0;
-        hash_table[index].relativeDepth = -1;
-        hash_table[index].eval = 0;
+    if (!hash_table) {
+        resize_hash_table(DEFAULT_HASH_MB);
     }
+    memset(hash_table, 0, (hash_mask + 1) * sizeof(tt_bucket));
+    hash_age = 0;
+}
+
+// Starts a new search: entries stored from now on are newer than all of the
+// ones before
+void age_hash_table() {
+    int age = __atomic_load_n(&hash_age, __ATOMIC_RELAXED);
+    __atomic_store_n(&hash_age, (age + 1) % TT_AGES, __ATOMIC_RELAXED);
+}
+
+// How full the table is with entries from the current search, in permill,
+// estimated from the first thousand entries (for UCI's "hashfull")
+int hash_table_permill() {
+    int used = 0;
+    int sampled = 0;
+    int current_age = __atomic_load_n(&hash_age, __ATOMIC_RELAXED);
+    for (U64 i = 0; (i <= hash_mask) && (sampled < 1000); i++) {
+        for (int j = 0; j < BUCKET_SIZE; j++) {
+            tt *entry = &hash_table[i].entries[j];
+            if (entry->hash_key && (ttAge(entry->data) == current_age)) {
+                used++;
+            }
+            sampled++;
+        }
+    }
+    return 1000 * used / sampled;
 }
 
 /*
@@ -212,156 +343,264 @@ that a rook capturing a pawn would update the key in three simple steps:
 - XOR the pawn's square
 - XOR the rook's destination square
 
+makeMove does exactly this alongside each change it makes to the bitboards,
+keeping the key in gs->hash. The extras are updated the same way: XOR out the
+old castling rights and en-passant file and XOR in the new ones, and XOR the
+turn code on every move. unmakeMove simply restores the old key.
+
 */
 
-// Updates hash key, taking an encoded move and the current hash, returning the
-// updated hash
-U64 update_hash(int move, U64 currentHash) {
-    square source_sq = decodeSource(move);
-    square dest_sq = decodeDest(move);
-    piece piec = decodePiece(move);
-    piece promoteTo = decodePromote(move);
-    int captureFlag = decodeCapture(move);
-    int doubleFlag = decodeDouble(move);
-    int enPassantFlag = decodeEnPassant(move);
-    int castleFlag = decodeCastle(move);
-    int color = decodeTurn(move);
-    int foe = 1 - color;
-    piece capturedPiec = decodeCapturedPiece(move);
-    // XOR using the piecetable keys and extra keys:
-    U64 retHash = currentHash;
-    // Source and destination
-    retHash ^= pieceCodes[2 * piec + color][source_sq];
-    retHash ^= pieceCodes[2 * piec + color][dest_sq];
-    // Destination if capturing
-    if (captureFlag)
-        retHash ^= pieceCodes[2 * capturedPiec + foe][dest_sq];
-    // Extras
-    if (doubleFlag && color)
-        retHash ^= enpassantCodes[(dest_sq - 8) % 8];
-    if (doubleFlag && foe)
-        retHash ^= enpassantCodes[(source_sq - 8) % 8];
-    if (enPassantFlag)
-        retHash ^= enpassantCodes[dest_sq];
-    if (promoteTo != pawn) {
-        retHash ^= pieceCodes[2 * promoteTo + color][dest_sq];
-        retHash ^= pieceCodes[2 * pawn + color][dest_sq];
-    }
-    if (castleFlag) {
-        for (int i = 0; i < 4; i++) {
-            retHash ^= castlingCodes[i];
-        }
+// Converts mate (and tablebase win) scores between relative to the root (as
+// searched) and relative to the position (as stored)
+static int scoreToHash(int eval, int ply) {
+    if (eval >= TB_WIN_BOUND) {
+        return eval + ply;
     }
-    // Check whether castling rights need to be updated:
-    // If not castling, but moving king, forbid castling
-    if (piec == king) {
-        for (int i = 0; i < 4; i++) {
-            retHash ^= castlingCodes[i];
-        }
+    if (eval <= -TB_WIN_BOUND) {
+        return eval - ply;
     }
-    // If capturing on or moving from any of the corner squares, forbid castling
-    // on this square
-    if ((source_sq == h1) || (dest_sq == h1)) {
-        retHash ^= castlingCodes[0];
-    }
-    if ((source_sq == a1) || (dest_sq == a1)) {
-        retHash ^= castlingCodes[1];
+    return eval;
+}
+
+static int scoreFromHash(int eval, int ply) {
+    if (eval >= TB_WIN_BOUND) {
+        return eval - ply;
     }
-    if ((source_sq == h8) || (dest_sq == h8)) {
-        retHash ^= castlingCodes[2];
+    if (eval <= -TB_WIN_BOUND) {
+        return eval + ply;
     }
-    if ((source_sq == a8) || (dest_sq == a8)) {
-        retHash ^= castlingCodes[3];
+    return eval;
+}
+
+// Finds the data stored for a position in its bucket. Returns 0 if it isn't
+// there (or the entry was torn by another thread writing it)
+static int findEntry(U64 hash, U64 *data) {
+    tt_bucket *bucket = &hash_table[hash & hash_mask];
+    for (int i = 0; i < BUCKET_SIZE; i++) {
+        // Read each half once, as another thread may be changing them
+        U64 key = bucket->entries[i].hash_key;
+        U64 entry_data = bucket->entries[i].data;
+        if ((key ^ entry_data) == hash) {
+            *data = entry_data;
+            return 1;
+        }
     }
-    // Switch turn
-    retHash ^= endTurnCode;
-    return retHash;
+    return 0;
 }
 
-// Tries to get an eval out of the hash table. Returns 1 for failure (no eval or
-// less depth), otherwise sets *eval to the value in the table
-int get_eval(U64 hash, int *eval, int relativeDepth, int alpha, int beta) {
-    int modHash = hash % BIGNUMBER;
-    if (hash_table[modHash].hash_key == hash) {
-        if (hash_table[modHash].relativeDepth >= relativeDepth) {
-            // Correct key and depth, extract eval/alpha/beta
-            if (hash_table[modHash].flag == EXACT) {
-                *eval = hash_table[modHash].eval;
-                return 0;
-            }
-            if ((hash_table[modHash].flag == ALPHA) &&
-                (hash_table[modHash].eval <= alpha)) {
-                *eval = alpha;
-                return 0;
-            }
-            if ((hash_table[modHash].flag == BETA) &&
-                (hash_table[modHash].eval >= beta)) {
-                *eval = beta;
-                return 0;
-            }
+// Tries to get an eval out of the hash table. Returns TT_USABLE and sets *eval
+// if the stored score can be used as is, TT_HIT if the position was found but
+// searched too shallowly (or its bound doesn't fit the window), and TT_MISS if
+// the position isn't in the table
+int get_eval(U64 hash, int *eval, int relativeDepth, int alpha, int beta,
+             int ply) {
+    U64 data;
+    if (!findEntry(hash, &data)) {
+        return TT_MISS;
+    }
+    if (ttDepth(data) >= relativeDepth) {
+        // Correct key and depth, extract eval/alpha/beta
+        int storedEval = scoreFromHash(ttEval(data), ply);
+        int flag = ttFlag(data);
+        if (flag == EXACT) {
+            *eval = storedEval;
+            return TT_USABLE;
+        }
+        if ((flag == ALPHA) && (storedEval <= alpha)) {
+            *eval = alpha;
+            return TT_USABLE;
+        }
+        if ((flag == BETA) && (storedEval >= beta)) {
+            *eval = beta;
+            return TT_USABLE;
         }
     }
-    // For any failure, return 1 (manually evaluate)
-    return 1;
+    // Otherwise, the position must be searched manually
+    return TT_HIT;
+}
+
+// Gets the best move found the last time this position was searched, to be
+// tried first. NULLMOVE if the position isn't in the table (or no move was
+// better than alpha)
+int get_hash_move(U64 hash) {
+    U64 data;
+    if (!findEntry(hash, &data)) {
+        return NULLMOVE;
+    }
+    return ttMove(data);
 }
 
 // Updates hash table, taking a key and a value (the evaluation score)
 void update_hash_table(U64 hash, int eval, int relativeDepth, int flag,
-                       int bestMove) {
-    int modHash = hash % BIGNUMBER;
-    hash_table[modHash].hash_key = hash;
-    hash_table[modHash].eval = eval;
-    hash_table[modHash].relativeDepth = relativeDepth;
-    hash_table[modHash].flag = flag;
-    hash_table[modHash].bestMove = bestMove;
+                       int bestMove, int ply) {
+    tt_bucket *bucket = &hash_table[hash & hash_mask];
+    int current_age = __atomic_load_n(&hash_age, __ATOMIC_RELAXED);
+    // Pick the entry to replace: the same position if it's there, otherwise
+    // the least valuable
+    tt *replace = &bucket->entries[0];
+    int replaceValue = INT_MAX;
+    for (int i = 0; i < BUCKET_SIZE; i++) {
+        tt *entry = &bucket->entries[i];
+        U64 entry_data = entry->data;
+        if ((entry->hash_key ^ entry_data) == hash) {
+            replace = entry;
+            // Keep the old best move if we don't have a new one
+            if (bestMove == NULLMOVE) {
+                bestMove = ttMove(entry_data);
+            }
+            break;
+        }
+        int age = (current_age - ttAge(entry_data) + TT_AGES) % TT_AGES;
+        int value = ttDepth(entry_data) - 8 * age;
+        if (value < replaceValue) {
+            replace = entry;
+            replaceValue = value;
+        }
+    }
+    U64 data = (U64)(unsigned)bestMove;
+    data |= (U64)(unsigned short)scoreToHash(eval, ply) << TT_EVAL_SHIFT;
+    data |= (U64)(relativeDepth & 0xFF) << TT_DEPTH_SHIFT;
+    data |= (U64)flag << TT_FLAG_SHIFT;
+    data |= (U64)current_age << TT_AGE_SHIFT;
+    replace->hash_key = hash ^ data;
+    replace->data = data;
 }
 
 // Debugging functions: these functions print their results
-// Takes a move, makes it, then undos the move, checking whether the hash
-// remains the same
-void debug_update(int move, char *label) {
-    // Randomly init hash
-    U64 initial_hash = random_bitstring(0);
-    U64 updated_hash = update_hash(move, initial_hash);
-    U64 undone_hash = update_hash(move, updated_hash);
-    if (initial_hash != undone_hash) {
-        printf("!!! FAILURE: %s update FAILED undo check\n", label);
+// Makes (then takes back) every legal move in a position, checking that the
+// key (and the evaluation sums, NNUE accumulators and mailbox) makeMove keeps
+// match those computed from scratch both times
+void debug_update(char *fen, char *label) {
+    game_state gs;
+    if (parse_fen(&gs, fen)) {
+        printf("!!! FAILURE: could not parse %s position\n", label);
+        return;
+    }
+    moves move_list;
+    undo_info undo;
+    U64 initial_hash = gs.hash;
+    int failures = 0;
+    generateLegalMoves(&move_list, &gs);
+    for (int i = 0; i < move_list.count; i++) {
+        int move = move_list.moves[i];
+        makeMove(move, &gs, &undo);
+        game_state fresh = gs;
+        init_eval(&fresh);
+        init_mailbox(&fresh);
+        if ((gs.hash != current_pos_hash(&gs)) ||
+            (gs.pawn_hash != current_pawn_hash(&gs)) ||
+            (gs.psqt != fresh.psqt) || (gs.phase != fresh.phase) ||
+            memcmp(gs.board, fresh.board, sizeof(gs.board)) ||
+            (nnue_enabled && memcmp(gs.accumulator, fresh.accumulator,
+                                    sizeof(gs.accumulator)))) {
+            failures++;
+        }
+        unmakeMove(move, &gs, &undo);
+        fresh = gs;
+        init_mailbox(&fresh);
+        init_eval(&fresh);
+        if ((gs.hash != initial_hash) ||
+            (gs.pawn_hash != current_pawn_hash(&gs)) ||
+            memcmp(gs.board, fresh.board, sizeof(gs.board)) ||
+            (nnue_enabled && memcmp(gs.accumulator, fresh.accumulator,
+                                    sizeof(gs.accumulator)))) {
+            failures++;
+        }
+    }
+    if (failures) {
+        printf("!!! FAILURE: %s updates FAILED %i of %i checks\n", label,
+               failures, 2 * move_list.count);
     } else {
-        printf("%s update passed undo check\n", label);
+        printf("%s updates passed all %i checks\n", label,
+               2 * move_list.count);
     }
 }
 
 // Uses the debug_update function to check every part of a move (moving,
 // capturing, castling, extras)
 void debug_all_updates() {
-    // Label constructors
-    char label[255];
-    char *colors[2] = {"white ", "black "};
-    char *pieces[6] = {"pawn", "knight", "bishop", "rook", "queen", "king"};
+    // Quiet moves, double pushes and castling both ways for both colors
+    debug_update(INIT_POS, "start position");
+    debug_update(
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "white castling and captures");
+    debug_update(
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b KQkq - 0 1",
+        "black castling and captures");
+    // Capturing rooks on their corners (losing the other side's rights)
+    debug_update("r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1",
+                 "corner captures");
+    // Promotion (with and without capturing)
+    debug_update("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 b kq - "
+                 "0 1",
+                 "promotion");
+    // En-passant capture
+    debug_update("8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1", "en-passant");
+    debug_update("rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+                 "en-passant (white)");
+}
 
-    // Test moving without capturing (each piece)
-    for (int i = 0; i < 12; i++) {
-        // Pseudorandom source/dest
-        U64 source_bb = (U64)1 << ((i * 7) % 63);
-        U64 dest_bb = (U64)1 << ((i * 13) % 63);
-        // Set source, dest, piece, and turn flag (all others set to 0)
-        int test_move = encodeMove(source_bb, dest_bb, (piece)(i / 2), 0, 0, 0,
-                                   0, 0, (i % 2), 0);
-        // Construct label
-        strcpy(label, "");
-        strcat(label, colors[i % 2]);
-        strcat(label, pieces[i / 2]);
-        strcat(label, " move");
-        debug_update(test_move, label);
-    }
+/*
+
+Perft can use a hash table too: the number of leaves below a position only
+depends on the position and the remaining depth, and deep perft runs reach
+the same positions over and over through transpositions. This table is kept
+separate from hash_table (a perft run shouldn't evict the search's entries or
+be confused by them), and is empty unless it is given a size.
+
+Each entry packs the depth into the low 8 bits alongside the node count. Since
+several perft threads may share the table, the key is stored XORed with the
+data: if two threads write the same entry at once and it ends up with one
+thread's key and the other's data, the check on lookup fails, and the entry
+is just a miss instead of a wrong count. That way no locks are needed.
 
-    // Test capturing (each piece -> each piece)
+*/
+typedef struct perftEntry_t {
+    U64 hash_key;
+    U64 data;
+} perft_entry;
+
+static perft_entry *perft_table = NULL;
+static U64 perft_mask = 0;
 
-    // Test promotion (each promotion)
+// (Re)allocates the perft table with the given size in megabytes, rounded
+// down to a power of two number of entries. A size of 0 frees the table
+void init_perft_table(int megabytes) {
+    free(perft_table);
+    perft_table = NULL;
+    perft_mask = 0;
+    if (megabytes <= 0) {
+        return;
+    }
+    U64 entries = 1;
+    while (entries * 2 * sizeof(perft_entry) <= (U64)megabytes << 20) {
+        entries *= 2;
+    }
+    perft_table = calloc(entries, sizeof(perft_entry));
+    if (perft_table) {
+        perft_mask = entries - 1;
+    }
+}
 
-    // Test doubling a pawn
+// Whether the perft table is in use
+int perft_table_enabled() { return perft_table != NULL; }
 
-    // Test en-passant capture
+// Looks up the node count for a position at a depth. Returns 1 for failure,
+// otherwise returns 0 and sets *nodes
+int get_perft_nodes(U64 hash, int depth, U64 *nodes) {
+    perft_entry *entry = &perft_table[hash & perft_mask];
+    U64 data = entry->data;
+    if (((entry->hash_key ^ data) == hash) && ((int)(data & 0xFF) == depth)) {
+        *nodes = data >> 8;
+        return 0;
+    }
+    return 1;
+}
 
-    // Test castling
-}
\ No newline at end of file
+// Stores the node count for a position at a depth (always replaces)
+void update_perft_table(U64 hash, int depth, U64 nodes) {
+    perft_entry *entry = &perft_table[hash & perft_mask];
+    U64 data = (nodes << 8) | (U64)depth;
+    entry->hash_key = hash ^ data;
+    entry->data = data;
+}
\ No newline at end of file
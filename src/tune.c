@@ -0,0 +1,238 @@
+#include "chess.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+  _______________________________________
+ /                                       \
+/   _   _   _                 _   _   _   \
+|  | |_| |_| |   _   _   _   | |_| |_| |  |
+|   \   _   /   | |_| |_| |   \   _   /   |
+|    | | | |     \       /     | | | |    |
+|    | |_| |______|     |______| |_| |    |
+|    |              ___              |    |
+|    |  _    _    (     )    _    _  |    |
+|    | | |  |_|  (       )  |_|  | | |    |
+|    | |_|       |       |       |_| |    |
+|   /            |_______|            \   |
+|  |___________________________________|  |
+\             Computer Chess              /
+ \_______________________________________/
+
+===========================================
+-------------------------------------------
+                TUNING DATA
+-------------------------------------------
+===========================================
+
+Texel tuning (tuning/texel.ipynb) fits the evaluation's tables to the results
+of real games: over many positions, the evaluation (through a sigmoid) should
+predict who went on to win. Doing that one position at a time through the
+command line would take days, so instead the engine turns a whole file of
+positions into a table the notebook can map straight into memory.
+
+Each input line is a FEN (or EPD: just the first four fields, with any move
+counters after them) followed by the game's result, in any of the usual forms:
+"1-0", "0-1", "1/2-1/2" (as in c9 "1-0";) or 1.0, 0.0, 0.5 (as in [0.5]).
+Positions are only worth tuning on if they're quiet, so each one is first
+played out to the end of its quiescence line (resolve_quiet in search.c);
+those left in check, or with a mate score, are dropped.
+
+The output file is a 16-byte header, then one fixed-size record per position,
+all little-endian:
+- header: the 8 bytes "ALDANTXL", then the record size and the number of
+  records, each as a 32-bit int
+- record: the result for white (0 = loss, 1 = draw, 2 = win), the game phase
+  (0 to 24, as evaluate() uses it), the number of pieces, one byte of padding,
+  the quiet position's evaluate() score for white (16 bits), two bytes of
+  padding, then TUNE_MAX_PIECES 16-bit features, unused ones 0xFFFF
+
+A feature is colored piece (2 * piece + color) * 64 plus the index into that
+piece's mg_/eg_ table in eval.c (63 - square for white, (63 - square) ^ 56 for
+black), so each one counts +1 (white) or -1 (black) of mg_value/mg_table (and
+likewise eg) for that piece and table entry, scaled by the phase as in
+evaluate().
+
+Lines are read in batches, each batch shared between the threads (which take
+positions in turn, as perft's threads take moves), then written in order, so
+the output doesn't depend on the number of threads.
+
+*/
+
+#define TUNE_MAGIC "ALDANTXL"
+#define TUNE_MAX_PIECES 32
+#define TUNE_BATCH 65536
+#define NO_FEATURE 0xFFFF
+
+typedef struct tuneRecord_t {
+    uint8_t result;
+    uint8_t phase;
+    uint8_t count;
+    uint8_t pad;
+    int16_t eval;
+    int16_t pad2;
+    uint16_t features[TUNE_MAX_PIECES];
+} tune_record;
+
+typedef struct tuneWorker_t {
+    char (*lines)[EPD_LINE]; // The batch being worked on
+    tune_record *records;    // One per line
+    int *keep;               // Whether each line gave a record
+    int count;               // Lines in the batch
+    int *next_line;          // Next line to take, shared by all threads
+    search_info *info;       // This thread's own search info
+} tune_worker;
+
+// The game result (for white) after the FEN: 0, 1 or 2, or -1 if none is found
+static int parseResult(char *text) {
+    if (strstr(text, "1/2") || strstr(text, "0.5")) {
+        return 1;
+    }
+    if (strstr(text, "1-0") || strstr(text, "1.0")) {
+        return 2;
+    }
+    if (strstr(text, "0-1") || strstr(text, "0.0")) {
+        return 0;
+    }
+    return -1;
+}
+
+// Splits a line into the position (see parse_epd) and the result. Returns
+// nonzero if the line couldn't be parsed
+static int parseLine(char *line, game_state *gs, int *result) {
+    char *rest = parse_epd(gs, line);
+    if (!rest) {
+        return 1;
+    }
+    *result = parseResult(rest);
+    return *result < 0;
+}
+
+// Turns a line into a record, returning 0 if the position isn't usable
+static int makeRecord(char *line, tune_record *record, search_info *info) {
+    game_state gs;
+    int result;
+    if (parseLine(line, &gs, &result)) {
+        return 0;
+    }
+    clear_search_info(info);
+    int score = resolve_quiet(&gs, info);
+    if ((score >= MATE_BOUND) || (score <= -MATE_BOUND) || inCheck(&gs)) {
+        return 0;
+    }
+    int eval = evaluate(&gs);
+    memset(record, 0, sizeof(tune_record));
+    record->result = result;
+    record->phase = gs.phase > 24 ? 24 : gs.phase;
+    record->eval = (gs.whose_turn == WHITE) ? eval : -eval;
+    for (square sq = h1; sq <= a8; sq++) {
+        int colored_piece = gs.board[sq];
+        if (colored_piece != NO_PIECE) {
+            if (record->count == TUNE_MAX_PIECES) {
+                return 0;
+            }
+            int table_index = (colored_piece & 1) ? ((63 - sq) ^ 56) : 63 - sq;
+            record->features[record->count++] = colored_piece * 64 + table_index;
+        }
+    }
+    for (int i = record->count; i < TUNE_MAX_PIECES; i++) {
+        record->features[i] = NO_FEATURE;
+    }
+    return 1;
+}
+
+static void *tuneWorker(void *arg) {
+    tune_worker *worker = (tune_worker *)arg;
+    int i;
+    while ((i = __atomic_fetch_add(worker->next_line, 1, __ATOMIC_RELAXED)) <
+           worker->count) {
+        worker->keep[i] =
+            makeRecord(worker->lines[i], &worker->records[i], worker->info);
+    }
+    return NULL;
+}
+
+int export_tuning_data(char *input_file, char *output_file, int threads) {
+    FILE *input = fopen(input_file, "r");
+    if (!input) {
+        printf("Could not open %s\n", input_file);
+        return -1;
+    }
+    FILE *output = fopen(output_file, "wb");
+    if (!output) {
+        printf("Could not open %s\n", output_file);
+        fclose(input);
+        return -1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    // Header, with the number of records filled in at the end
+    int32_t record_size = sizeof(tune_record);
+    int32_t records = 0;
+    fwrite(TUNE_MAGIC, 1, 8, output);
+    fwrite(&record_size, sizeof(record_size), 1, output);
+    fwrite(&records, sizeof(records), 1, output);
+
+    char(*lines)[EPD_LINE] = malloc(TUNE_BATCH * EPD_LINE);
+    tune_record *batch = MALLOC(TUNE_BATCH, tune_record);
+    int *keep = MALLOC(TUNE_BATCH, int);
+    tune_worker *workers = MALLOC(threads, tune_worker);
+    pthread_t *handles = MALLOC(threads, pthread_t);
+    for (int t = 0; t < threads; t++) {
+        workers[t].info = MALLOC(1, search_info);
+    }
+    int lines_read = 0;
+    int start_ms = get_time_ms();
+    int count;
+    do {
+        count = 0;
+        while ((count < TUNE_BATCH) && fgets(lines[count], EPD_LINE, input)) {
+            // Skip comments and blank lines
+            if ((lines[count][0] != '#') && !isspace(lines[count][0])) {
+                count++;
+            }
+        }
+        int next_line = 0;
+        for (int t = 0; t < threads; t++) {
+            workers[t].lines = lines;
+            workers[t].records = batch;
+            workers[t].keep = keep;
+            workers[t].count = count;
+            workers[t].next_line = &next_line;
+            pthread_create(&handles[t], NULL, tuneWorker, &workers[t]);
+        }
+        for (int t = 0; t < threads; t++) {
+            pthread_join(handles[t], NULL);
+        }
+        for (int i = 0; i < count; i++) {
+            if (keep[i]) {
+                fwrite(&batch[i], sizeof(tune_record), 1, output);
+                records++;
+            }
+        }
+        lines_read += count;
+        printf("%i positions read, %i kept\n", lines_read, records);
+        fflush(stdout);
+    } while (count == TUNE_BATCH);
+    fseek(output, 12, SEEK_SET);
+    fwrite(&records, sizeof(records), 1, output);
+    fclose(output);
+    fclose(input);
+    printf("Wrote %i records to %s in %i ms\n", records, output_file,
+           get_time_ms() - start_ms);
+
+    for (int t = 0; t < threads; t++) {
+        free(workers[t].info);
+    }
+    free(handles);
+    free(workers);
+    free(keep);
+    free(batch);
+    free(lines);
+    return records;
+}